@@ -2,7 +2,13 @@
 #include "bsp.h"
 #include "src/ble_spp_server.h"
 #include "src/console_ll.h"
+#include "src/spp_trace.h"
 #define BUFSIZE 256
+#define MAIN_DBG DEBUG_CONSOLE_INTERFACE
+/*Echo length prefixed binary records instead of text lines*/
+#define MAIN_RECORD_MODE 0
+/*An echo that cannot leave within this time is dropped, so a stalled uplink does not stop the downlink being read*/
+#define MAIN_ECHO_TIMEOUT_MS 100
 static const char *TAG = "main";
 SemaphoreHandle_t new_line_sem;
 static size_t read_size = 0;
@@ -12,22 +18,41 @@ static void __release_sem();
 void app_main() {
     char buf[BUFSIZE];
     read_size = 0;
-    new_line_sem = xSemaphoreCreateBinary();
+    new_line_sem = SPP_BINARY_SEMAPHORE_CREATE();
     uint16_t idx = 0;
+#if (MAIN_RECORD_MODE == 1)
+    size_t rec_len;
+    console_ll_set_mode(CONSOLE_LL_MODE_RECORD);
+#endif
     console_ll_init(__release_sem);
     while (true) {
         /* This will block until a new line is ready */
         if (pdPASS == xSemaphoreTake(new_line_sem, portMAX_DELAY)) {
+            SPP_TRACE(SPP_TRACE_APP_WAKEUP, 0, read_size);
+#if (MAIN_RECORD_MODE == 1)
+            /*Several records may have arrived for one wakeup*/
+            while ((rec_len = console_ll_recv_record((uint8_t *)buf, BUFSIZE, 0)) > 0) {
+                if (ESP_OK != console_ll_send_record((uint8_t *)buf, (rec_len < BUFSIZE) ? rec_len : BUFSIZE,
+                                                     pdMS_TO_TICKS(MAIN_ECHO_TIMEOUT_MS))) {
+                    ESP_LOGW(TAG, "Uplink stalled, dropping echo of %d bytes", (int)rec_len);
+                }
+            }
+            continue;
+#endif
             ESP_ERROR_CHECK((read_size < BUFSIZE) ? ESP_OK : ESP_FAIL);
+#if (MAIN_DBG == 1)
             ESP_LOGI(TAG, "Processing new line");
+#endif
             for (int i = 0; i < read_size; i++) {
                 buf[i] = console_ll_getc(true);
             }
             /*Echo back reply*/
             buf[read_size] = '\0';
+#if (MAIN_DBG == 1)
             ESP_LOGI(TAG, "New string len\t%d:\t[%s]", read_size, buf);
-            for (int i = 0; i < read_size; i++) {
-                console_ll_putc(buf[i]);
+#endif
+            if (console_ll_write((uint8_t *)buf, read_size, CONSOLE_LL_TX_BLOCK, pdMS_TO_TICKS(MAIN_ECHO_TIMEOUT_MS)) < read_size) {
+                ESP_LOGW(TAG, "Uplink stalled, echo cut short");
             }
             memset(buf, 0, idx);
             read_size = 0;
@@ -36,7 +61,14 @@ void app_main() {
 }
 
 static void __release_sem(size_t num_elements) {
+#if (MAIN_DBG == 1)
     ESP_LOGI(TAG, "newline");
+#endif
     read_size = num_elements;
+#if (MAIN_RECORD_MODE == 1)
+    /*Records are queued in console_ll, a pending wakeup already covers this one*/
+    xSemaphoreGive(new_line_sem);
+#else
     MY_ASSERT_EQ(xSemaphoreGive(new_line_sem), pdPASS);
+#endif
 }
\ No newline at end of file
@@ -7,6 +7,11 @@
 
 #include "ble_spp_server.h"
 #include "bsp.h"
+#include "console_ll.h"
+#include "spp_capture.h"
+#include "spp_delta.h"
+#include "spp_session.h"
+#include "spp_trace.h"
 #include "esp_bt.h"
 #include "esp_bt_defs.h"
 #include "esp_bt_main.h"
@@ -14,6 +19,7 @@
 #include "esp_gatts_api.h"
 #include "esp_log.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "freertos/task.h"
@@ -27,7 +33,68 @@
 #define ESP_SPP_APP_ID 0x56
 #define SAMPLE_DEVICE_NAME "ESP_SPP_SERVER"
 #define SPP_SVC_INST_ID 0
-#define UPLINK_BUFSIZE 512
+/*Commands written to the command characteristic*/
+#define SPP_CMD_TRACE_DUMP "TRACE"
+#define SPP_CMD_MEM_REPORT "MEM"
+#define SPP_CMD_CAPTURE_DUMP "CAPTURE"
+#define SPP_CMD_BOOT_REPORT "BOOT"
+#define SPP_CMD_DELTA_REPORT "DELTA"
+#define SPP_CMD_REL_ON "REL1"
+#define SPP_CMD_REL_OFF "REL0"
+#define SPP_CMD_PULL_ON "PULL1"
+#define SPP_CMD_PULL_OFF "PULL0"
+#define SPP_REL_HDR_LEN (2) /*Sequence number in front of every reliable notification*/
+#define SPP_REL_ACK_LEN (4) /*'A' 'K' seq_lo seq_hi*/
+
+/*Static RAM taken by the link in SPP_STATIC_ALLOCATION mode, control blocks included. Stacks are in bytes on this port.*/
+#if (SPP_ASYNC_INIT == 1)
+#define SPP_STATIC_RAM_INIT (SPP_INIT_TASK_STACK + sizeof(StaticTask_t))
+#else
+#define SPP_STATIC_RAM_INIT (0)
+#endif
+#define SPP_STATIC_RAM_CONSOLE                                                                          \
+    (2 * (CONSOLE_PRINT_SIZE + sizeof(StaticQueue_t)) + CONSOLE_RECORD_RING_SIZE + sizeof(StaticRingbuffer_t) + \
+     sizeof(console_ll_rx_record_t) + sizeof(StaticSemaphore_t) + sizeof(StaticEventGroup_t) + SPP_STATIC_RAM_INIT)
+#ifdef SUPPORT_HEARTBEAT
+#define SPP_STATIC_RAM_HEARTBEAT \
+    (SPP_HEARTBEAT_QUEUE_LEN * sizeof(uint32_t) + sizeof(StaticQueue_t) + SPP_HEARTBEAT_TASK_STACK + sizeof(StaticTask_t))
+#else
+#define SPP_STATIC_RAM_HEARTBEAT (0)
+#endif
+#define SPP_STATIC_RAM_SERVER                                                                   \
+    (sizeof(StaticSemaphore_t) + SPP_CMD_QUEUE_LEN * sizeof(spp_cmd_t) + sizeof(StaticQueue_t) + \
+     SPP_LINK_TASK_STACK + SPP_CMD_TASK_STACK + 2 * sizeof(StaticTask_t) + SPP_PREP_BUF_LEN +       \
+     SPP_STATIC_RAM_HEARTBEAT)
+#if (SPP_TRACE_ENABLE == 1)
+#define SPP_STATIC_RAM_TRACE (SPP_TRACE_DEPTH * 8)
+#else
+#define SPP_STATIC_RAM_TRACE (0)
+#endif
+#if (SPP_RELIABLE_UPLINK == 1)
+#define SPP_STATIC_RAM_REL (SPP_REL_WINDOW * (SPP_REL_SLOT_LEN + SPP_REL_HDR_LEN + 1) + sizeof(StaticSemaphore_t))
+#else
+#define SPP_STATIC_RAM_REL (0)
+#endif
+#if (SPP_PULL_UPLINK == 1)
+#define SPP_STATIC_RAM_PULL (SPP_PULL_LEN + sizeof(esp_gatt_rsp_t) + sizeof(StaticSemaphore_t))
+#else
+#define SPP_STATIC_RAM_PULL (0)
+#endif
+#if (SPP_CAPTURE_ENABLE == 1)
+#define SPP_STATIC_RAM_CAPTURE (SPP_CAPTURE_SIZE + SPP_CAPTURE_PUTC_COALESCE)
+#else
+#define SPP_STATIC_RAM_CAPTURE (0)
+#endif
+#if (SPP_BROADCAST_ENABLE == 1)
+#define SPP_STATIC_RAM_BCAST (ESP_BLE_ADV_DATA_LEN_MAX + ESP_BLE_SCAN_RSP_DATA_LEN_MAX + SPP_BROADCAST_MAX_LEN)
+#else
+#define SPP_STATIC_RAM_BCAST (0)
+#endif
+#define SPP_STATIC_RAM_DELTA (SPP_DELTA_MAX_SCHEMAS * sizeof(spp_delta_enc_t))
+#define SPP_STATIC_RAM_TOTAL (SPP_STATIC_RAM_BCAST + SPP_STATIC_RAM_CAPTURE + SPP_STATIC_RAM_PULL + SPP_STATIC_RAM_REL + SPP_STATIC_RAM_CONSOLE + SPP_STATIC_RAM_SERVER + SPP_NTF_BUF_LEN + SPP_STATIC_RAM_TRACE + SPP_STATIC_RAM_DELTA)
+#if (SPP_STATIC_ALLOCATION == 1)
+_Static_assert(SPP_STATIC_RAM_TOTAL <= SPP_STATIC_RAM_BUDGET, "ble link static RAM exceeds SPP_STATIC_RAM_BUDGET, see spp_config.h");
+#endif
 /// SPP Service
 static const uint16_t spp_service_uuid = 0xABF0;
 /// Characteristic UUID
@@ -49,6 +116,10 @@ static uint16_t spp_mtu_size = 23;
 static uint16_t spp_conn_id = 0xffff;
 static esp_gatt_if_t spp_gatts_if = 0xff;
 static xQueueHandle cmd_cmd_queue = NULL;
+static TaskHandle_t link_task_handle = NULL;
+static TaskHandle_t cmd_task_handle = NULL;
+/*One outgoing fragment, only touched by link_task*/
+static uint8_t ntf_value[SPP_NTF_BUF_LEN];
 /* Added by me to integrate with interface functionally */
 static ble_spp_read_fun_t __my_read_cb = NULL;
 static ble_spp_write_fun_t __my_write_cb = NULL;
@@ -58,18 +129,27 @@ static void __release_ble_uplink();
 
 #ifdef SUPPORT_HEARTBEAT
 static xQueueHandle cmd_heartbeat_queue = NULL;
+static TaskHandle_t heartbeat_task_handle = NULL;
 static uint8_t heartbeat_s[9] = {'E', 's', 'p', 'r', 'e', 's', 's', 'i', 'f'};
 static bool enable_heart_ntf = false;
 static uint8_t heartbeat_count_num = 0;
 #endif
 
 static bool enable_data_ntf = false;
+static bool is_congested = false;
 static bool is_connected = false;
+static bool raw_uplink = false; /*Uplink is a record stream, see ble_spp_set_raw_uplink()*/
 static esp_bd_addr_t spp_remote_bda = {
     0x0,
 };
 
 static uint16_t spp_handle_table[SPP_IDX_NB];
+/*Startup profile, us since boot when each phase was first reached*/
+static int64_t boot_us[SPP_BOOT_PHASE_NUM];
+static const char *boot_phase_name[SPP_BOOT_PHASE_NUM] = {
+    "console_ll_init", "app running", "nvs", "controller init", "controller enable", "bluedroid init",
+    "bluedroid enable", "app register", "gatts registered", "attribute table", "advertising",
+};
 
 static esp_ble_adv_params_t spp_adv_params = {
     .adv_int_min = 0x20,
@@ -95,6 +175,7 @@ struct gatts_profile_inst {
     esp_bt_uuid_t descr_uuid;
 };
 
+#if (SPP_STATIC_ALLOCATION == 0)
 typedef struct spp_receive_data_node {
     int32_t len;
     uint8_t *node_buff;
@@ -114,6 +195,7 @@ static spp_receive_data_buff_t SppRecvDataBuff = {
     .node_num = 0,
     .buff_size = 0,
     .first_node = NULL};
+#endif
 
 static void gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
 
@@ -149,6 +231,12 @@ static const uint8_t spp_data_receive_val[20] = {0x00};
 ///SPP Service - data notify characteristic, notify&read
 static const uint16_t spp_data_notify_uuid = ESP_GATT_UUID_SPP_DATA_NOTIFY;
 static const uint8_t spp_data_notify_val[20] = {0x00};
+/*In pull mode reads of the value are answered from the uplink, see __pull_read()*/
+#if (SPP_PULL_UPLINK == 1)
+#define SPP_DATA_NTY_RSP ESP_GATT_RSP_BY_APP
+#else
+#define SPP_DATA_NTY_RSP ESP_GATT_AUTO_RSP
+#endif
 static const uint8_t spp_data_notify_ccc[2] = {0x00, 0x00};
 
 ///SPP Service - command characteristic, read&write without response
@@ -188,7 +276,7 @@ static const esp_gatts_attr_db_t spp_gatt_db[SPP_IDX_NB] =
 
         //SPP -  data notify characteristic Value
         [SPP_IDX_SPP_DATA_NTY_VAL] =
-            {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&spp_data_notify_uuid, ESP_GATT_PERM_READ, SPP_DATA_MAX_LEN, sizeof(spp_data_notify_val), (uint8_t *)spp_data_notify_val}},
+            {{SPP_DATA_NTY_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&spp_data_notify_uuid, ESP_GATT_PERM_READ, SPP_DATA_MAX_LEN, sizeof(spp_data_notify_val), (uint8_t *)spp_data_notify_val}},
 
         //SPP -  data notify characteristic - Client Characteristic Configuration Descriptor
         [SPP_IDX_SPP_DATA_NTF_CFG] =
@@ -241,6 +329,31 @@ static uint8_t find_char_and_desr_index(uint16_t handle) {
     return error;
 }
 
+#if (SPP_STATIC_ALLOCATION == 1)
+/*Prepared writes are collected in a fixed buffer, writes beyond it are dropped*/
+static uint8_t prep_write_buf[SPP_PREP_BUF_LEN];
+static size_t prep_write_len = 0;
+
+static bool store_wr_buffer(esp_ble_gatts_cb_param_t *p_data) {
+    if ((prep_write_len + p_data->write.len) > SPP_PREP_BUF_LEN) {
+        ESP_LOGE(GATTS_TABLE_TAG, "%s prepare write exceeds %d bytes\n", __func__, SPP_PREP_BUF_LEN);
+        return false;
+    }
+    memcpy(&prep_write_buf[prep_write_len], p_data->write.value, p_data->write.len);
+    prep_write_len += p_data->write.len;
+    return true;
+}
+
+static void free_write_buffer(void) {
+    prep_write_len = 0;
+}
+
+static void print_write_buffer(void) {
+    if ((NULL != __my_write_cb) && (prep_write_len > 0)) {
+        __my_write_cb((char *)prep_write_buf, prep_write_len);
+    }
+}
+#else
 static bool store_wr_buffer(esp_ble_gatts_cb_param_t *p_data) {
     temp_spp_recv_data_node_p1 = (spp_receive_data_node_t *)malloc(sizeof(spp_receive_data_node_t));
 
@@ -292,55 +405,586 @@ static void print_write_buffer(void) {
         temp_spp_recv_data_node_p1 = temp_spp_recv_data_node_p1->next_node;
     }
 }
+#endif
+
+#if (SPP_RELIABLE_UPLINK == 1)
+/*Reliable uplink, opt in by writing REL1 to the command characteristic.
+  Every notification on the data characteristic then starts with a 16bit little endian sequence number.
+  The client acknowledges cumulatively by writing 'A' 'K' seq_lo seq_hi to the command characteristic, the last sequence it received in order.
+  Up to SPP_REL_WINDOW notifications are in flight, after SPP_REL_TIMEOUT_MS without progress all unacknowledged ones are sent again (go back N).
+  The client drops anything that is not the next expected sequence, so every byte is delivered exactly once and in order.
+  Every enable starts a new sequence space with a notification that carries only sequence 0, acknowledged like any other.
+  Bytes the client had not acknowledged in the previous space, e.g. before a disconnect or a reboot, are lost.
+*/
+static struct {
+    bool enabled;
+    volatile bool enable_req;
+    volatile bool resend_req;
+    volatile bool reset_req; /*Set on disconnect, link_task drops the window before it sends again*/
+    volatile uint16_t base; /*Oldest unacknowledged sequence, advanced by acks*/
+    uint16_t next;          /*Next sequence to send, only link_task touches it*/
+    uint8_t len[SPP_REL_WINDOW];
+    uint8_t slot[SPP_REL_WINDOW][SPP_REL_HDR_LEN + SPP_REL_SLOT_LEN];
+    uint32_t retransmits;
+} rel;
+static SemaphoreHandle_t rel_ack_sem = NULL;
+static portMUX_TYPE rel_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint16_t __rel_in_flight() {
+    return (uint16_t)(rel.next - rel.base);
+}
+
+static void __rel_transmit(uint16_t seq) {
+    uint8_t idx = seq & (SPP_REL_WINDOW - 1);
+    esp_err_t ret = esp_ble_gatts_send_indicate(spp_gatts_if, spp_conn_id, spp_handle_table[SPP_IDX_SPP_DATA_NTY_VAL], rel.len[idx], rel.slot[idx], false);
+    if (ESP_OK != ret) {
+        /*Left in the window, the retransmit timeout picks it up*/
+        SPP_TRACE(SPP_TRACE_TX_ERROR, 0, ret);
+        return;
+    }
+    SPP_TRACE(SPP_TRACE_TX_FRAGMENT, idx, rel.len[idx]);
+}
+
+static void __rel_retransmit() {
+    uint16_t seq;
+    uint16_t end;
+    if (is_congested) {
+        /*The window would only fail again in a congested stack, CONGEST_EVT asks for one resend once it clears*/
+        rel.resend_req = true;
+        return;
+    }
+    seq = rel.base;
+    end = rel.next;
+    rel.resend_req = false;
+    if (!is_connected || !enable_data_ntf || rel.reset_req || (seq == end)) {
+        return;
+    }
+    SPP_TRACE(SPP_TRACE_REL_RETX, (uint8_t)(end - seq), seq);
+    for (; seq != end; seq++) {
+        __rel_transmit(seq);
+        rel.retransmits++;
+    }
+}
+
+static void __rel_ack(uint16_t seq) {
+    SPP_TRACE(SPP_TRACE_REL_ACK, 0, seq);
+    portENTER_CRITICAL(&rel_mux);
+    /*Ignore stale and out of window acks*/
+    if ((uint16_t)(seq - rel.base) < (uint16_t)(rel.next - rel.base)) {
+        rel.base = seq + 1;
+    }
+    portEXIT_CRITICAL(&rel_mux);
+    xSemaphoreGive(rel_ack_sem);
+}
+
+/*Applies REL1/REL0 from the command task and the reset of a disconnect in link_task context, an enable starts with the sync notification*/
+static void __rel_apply_enable() {
+    if ((rel.enable_req != rel.enabled) || rel.reset_req) {
+        portENTER_CRITICAL(&rel_mux);
+        rel.base = 0;
+        rel.next = 0;
+        rel.enabled = rel.enable_req;
+        rel.reset_req = false;
+        portEXIT_CRITICAL(&rel_mux);
+        ESP_LOGI(GATTS_TABLE_TAG, "Reliable uplink %s, %u notifications resent so far", rel.enabled ? "on" : "off", (unsigned)rel.retransmits);
+        if (rel.enabled) {
+            rel.slot[0][0] = 0;
+            rel.slot[0][1] = 0;
+            rel.len[0] = SPP_REL_HDR_LEN;
+            portENTER_CRITICAL(&rel_mux);
+            rel.next = 1;
+            portEXIT_CRITICAL(&rel_mux);
+            if (is_connected && enable_data_ntf) {
+                __rel_transmit(0);
+            }
+        }
+    }
+}
+
+/*Disconnect: the next client starts without reliable mode unless its restored session turns it on again*/
+static void __rel_reset() {
+    portENTER_CRITICAL(&rel_mux);
+    rel.enable_req = false;
+    rel.reset_req = true;
+    portEXIT_CRITICAL(&rel_mux);
+    xSemaphoreGive(rel_ack_sem);
+}
+
+/*The line being sent has no window left to go to*/
+static bool __rel_abort() {
+    return !is_connected || rel.reset_req || (rel.enable_req != rel.enabled);
+}
+
+static TickType_t __rel_wait_ticks() {
+    return (rel.enabled && (__rel_in_flight() > 0)) ? pdMS_TO_TICKS(SPP_REL_TIMEOUT_MS) : portMAX_DELAY;
+}
+
+static void __rel_send(const uint8_t *buf, size_t len) {
+    size_t off = 0;
+    size_t chunk;
+    uint8_t idx;
+    while (off < len) {
+        /*Window full or link congested, progress comes from acks, timeouts resend the window*/
+        while (!__rel_abort() && ((__rel_in_flight() >= SPP_REL_WINDOW) || is_congested || !enable_data_ntf)) {
+            if ((pdPASS != xSemaphoreTake(rel_ack_sem, pdMS_TO_TICKS(SPP_REL_TIMEOUT_MS))) || rel.resend_req) {
+                __rel_retransmit();
+            }
+        }
+        if (__rel_abort()) {
+            ESP_LOGW(GATTS_TABLE_TAG, "Reliable uplink stopped, %u bytes of the line dropped", (unsigned)(len - off));
+            return;
+        }
+        chunk = ((spp_mtu_size - 3) < (SPP_REL_HDR_LEN + SPP_REL_SLOT_LEN)) ? (spp_mtu_size - 3) : (SPP_REL_HDR_LEN + SPP_REL_SLOT_LEN);
+        chunk -= SPP_REL_HDR_LEN;
+        chunk = ((len - off) < chunk) ? (len - off) : chunk;
+        idx = rel.next & (SPP_REL_WINDOW - 1);
+        rel.slot[idx][0] = rel.next & 0xff;
+        rel.slot[idx][1] = (rel.next >> 8) & 0xff;
+        memcpy(&rel.slot[idx][SPP_REL_HDR_LEN], buf + off, chunk);
+        rel.len[idx] = chunk + SPP_REL_HDR_LEN;
+        portENTER_CRITICAL(&rel_mux);
+        rel.next++;
+        portEXIT_CRITICAL(&rel_mux);
+        __rel_transmit(rel.next - 1);
+        off += chunk;
+    }
+}
+#else
+#define __rel_wait_ticks() (portMAX_DELAY)
+#endif
+
+#if (SPP_PULL_UPLINK == 1)
+/*Pull mode, PULL1/PULL0 on the command characteristic. link_task leaves the uplink alone and the client reads the
+  data characteristic instead, long reads included. A read at offset 0 starts a new value: the bytes earlier
+  responses delivered are dropped, the rest moves to the front and is topped up from the uplink to SPP_PULL_LEN.
+  Read blobs walk that value, so a client that stops early or only does plain reads loses nothing.
+  Reads come in on the bluedroid task, the lock keeps them off the uplink while link_task switches modes.
+*/
+static struct {
+    bool enabled; /*Changed by link_task or on disconnect with lock held*/
+    volatile bool enable_req;
+    uint16_t len;    /*Bytes in buf*/
+    uint16_t served; /*Bytes of buf responses have delivered*/
+    uint32_t reads;
+    uint32_t bytes;
+    uint8_t buf[SPP_PULL_LEN];
+} pull;
+static SemaphoreHandle_t pull_lock = NULL;
+static esp_gatt_rsp_t pull_rsp; /*Too large for the bluedroid task stack*/
+
+static void __pull_apply_enable() {
+    if (pull.enable_req != pull.enabled) {
+        MY_ASSERT_EQ(xSemaphoreTake(pull_lock, portMAX_DELAY), pdPASS);
+        if (pull.len > pull.served) {
+            ESP_LOGW(GATTS_TABLE_TAG, "Pull off, %u bytes read from the uplink were never delivered", (unsigned)(pull.len - pull.served));
+        }
+        pull.len = 0;
+        pull.served = 0;
+        pull.enabled = pull.enable_req;
+        xSemaphoreGive(pull_lock);
+        ESP_LOGI(GATTS_TABLE_TAG, "Pull mode %s, %u reads, %u bytes so far", pull.enabled ? "on" : "off", (unsigned)pull.reads, (unsigned)pull.bytes);
+    }
+}
+
+/*Disconnect: the next client starts with notifications, bytes taken from the uplink for this one are dropped*/
+static void __pull_reset() {
+    MY_ASSERT_EQ(xSemaphoreTake(pull_lock, portMAX_DELAY), pdPASS);
+    if (pull.len > pull.served) {
+        ESP_LOGW(GATTS_TABLE_TAG, "Disconnected in pull mode, %u bytes read from the uplink were never delivered", (unsigned)(pull.len - pull.served));
+    }
+    pull.len = 0;
+    pull.served = 0;
+    pull.enable_req = false;
+    pull.enabled = false;
+    xSemaphoreGive(pull_lock);
+}
+
+static void __pull_refill() {
+    size_t avail = (__my_get_uplink_len_cb != NULL) ? (__my_get_uplink_len_cb()) : 0;
+    size_t n = SPP_PULL_LEN - (pull.len - pull.served);
+    memmove(pull.buf, &pull.buf[pull.served], pull.len - pull.served);
+    pull.len -= pull.served;
+    pull.served = 0;
+    n = (avail < n) ? avail : n;
+    if ((n > 0) && (NULL != __my_read_cb)) {
+        /*A producer dropping oldest bytes may take some of the counted ones, only what was there is added*/
+        pull.len += __my_read_cb(&pull.buf[pull.len], n, 0);
+    }
+}
+
+/*Answers a read or read blob of the data characteristic, at most MTU - 1 bytes from the requested offset*/
+static void __pull_read(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *p_data) {
+    esp_gatt_status_t status = ESP_GATT_OK;
+    uint16_t offset = p_data->read.offset;
+    uint16_t n = 0;
+    if (!p_data->read.need_rsp) {
+        return;
+    }
+    MY_ASSERT_EQ(xSemaphoreTake(pull_lock, portMAX_DELAY), pdPASS);
+    if (pull.enabled) {
+        if (0 == offset) {
+            __pull_refill();
+        }
+        if (offset > pull.len) {
+            status = ESP_GATT_INVALID_OFFSET;
+        } else {
+            n = pull.len - offset;
+            n = (n < (spp_mtu_size - 1)) ? n : (spp_mtu_size - 1);
+            memcpy(pull_rsp.attr_value.value, &pull.buf[offset], n);
+            pull.served = ((offset + n) > pull.served) ? (offset + n) : pull.served;
+            pull.reads++;
+            pull.bytes += n;
+        }
+    }
+    xSemaphoreGive(pull_lock);
+    pull_rsp.attr_value.handle = p_data->read.handle;
+    pull_rsp.attr_value.offset = offset;
+    pull_rsp.attr_value.len = n;
+    esp_ble_gatts_send_response(gatts_if, p_data->read.conn_id, p_data->read.trans_id, status, &pull_rsp);
+    SPP_TRACE(SPP_TRACE_PULL, (0 == offset) ? 0 : 1, n);
+}
+
+bool ble_spp_pull_active() {
+    return pull.enabled;
+}
+#else
+bool ble_spp_pull_active() {
+    return false;
+}
+#endif
+
+#if (SPP_BROADCAST_ENABLE == 1)
+/*Broadcast telemetry. Producers overwrite the record at any rate, a periodic timer puts the latest one on air
+  at most once per SPP_BROADCAST_PERIOD_MS (SPP_BROADCAST_PERIOD_CONNECTED_MS while connected).
+  Both halves carry the same sequence byte so observers can pair an advertisement with its scan response:
+  adv: flags, service uuid, manufacturer data [company id][seq][first SPP_BROADCAST_ADV_LEN bytes]
+  rsp: device name, manufacturer data [company id][seq][remaining bytes]
+*/
+#define SPP_ADV_HEAD_LEN (7)  /*flags and service uuid of spp_adv_data*/
+#define SPP_ADV_MANUF_HDR (5) /*ad length, ad type, company id, seq*/
+_Static_assert(SPP_ADV_HEAD_LEN + SPP_ADV_MANUF_HDR + SPP_BROADCAST_ADV_LEN <= ESP_BLE_ADV_DATA_LEN_MAX, "broadcast does not fit the advertisement");
+_Static_assert(sizeof(spp_adv_data) - SPP_ADV_HEAD_LEN + SPP_ADV_MANUF_HDR + SPP_BROADCAST_RSP_LEN <= ESP_BLE_SCAN_RSP_DATA_LEN_MAX,
+               "broadcast does not fit the scan response");
+
+static struct {
+    uint8_t rec[SPP_BROADCAST_MAX_LEN];
+    size_t len;
+    bool dirty;
+    uint8_t seq;
+    int64_t last_us;
+    esp_timer_handle_t timer;
+} bcast;
+static portMUX_TYPE bcast_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t bcast_adv[ESP_BLE_ADV_DATA_LEN_MAX];
+static uint8_t bcast_rsp[ESP_BLE_SCAN_RSP_DATA_LEN_MAX];
+/*Non connectable while a central is connected and slower, so the connection events keep the air time*/
+static esp_ble_adv_params_t bcast_adv_params = {
+    .adv_int_min = SPP_BROADCAST_ADV_INT,
+    .adv_int_max = SPP_BROADCAST_ADV_INT,
+    .adv_type = ADV_TYPE_SCAN_IND,
+    .own_addr_type = BLE_ADDR_TYPE_PUBLIC,
+    .channel_map = ADV_CHNL_ALL,
+    .adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
+};
+
+static size_t __bcast_put_manuf(uint8_t *dst, const uint8_t *src, size_t len, uint8_t seq) {
+    dst[0] = SPP_ADV_MANUF_HDR - 1 + len;
+    dst[1] = ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE;
+    dst[2] = SPP_BROADCAST_COMPANY_ID & 0xff;
+    dst[3] = (SPP_BROADCAST_COMPANY_ID >> 8) & 0xff;
+    dst[4] = seq;
+    memcpy(dst + SPP_ADV_MANUF_HDR, src, len);
+    return SPP_ADV_MANUF_HDR + len;
+}
+
+/*Builds both payloads from the current record and hands them to the stack, advertising (re)starts on ADV_DATA_RAW_SET_COMPLETE*/
+static void __bcast_apply() {
+    uint8_t rec[SPP_BROADCAST_MAX_LEN];
+    size_t len, adv_len, rsp_len;
+    uint8_t seq;
+    portENTER_CRITICAL(&bcast_mux);
+    memcpy(rec, bcast.rec, bcast.len);
+    len = bcast.len;
+    seq = ++bcast.seq;
+    bcast.dirty = false;
+    bcast.last_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&bcast_mux);
+
+    memcpy(bcast_adv, spp_adv_data, SPP_ADV_HEAD_LEN);
+    adv_len = SPP_ADV_HEAD_LEN + __bcast_put_manuf(&bcast_adv[SPP_ADV_HEAD_LEN], rec, (len < SPP_BROADCAST_ADV_LEN) ? len : SPP_BROADCAST_ADV_LEN, seq);
+    rsp_len = sizeof(spp_adv_data) - SPP_ADV_HEAD_LEN;
+    memcpy(bcast_rsp, &spp_adv_data[SPP_ADV_HEAD_LEN], rsp_len);
+    if (len > SPP_BROADCAST_ADV_LEN) {
+        rsp_len += __bcast_put_manuf(&bcast_rsp[rsp_len], &rec[SPP_BROADCAST_ADV_LEN], len - SPP_BROADCAST_ADV_LEN, seq);
+    }
+    esp_ble_gap_config_scan_rsp_data_raw(bcast_rsp, rsp_len);
+    esp_ble_gap_config_adv_data_raw(bcast_adv, adv_len);
+}
+
+static void __bcast_tick(void *arg) {
+    int64_t period_us = 1000LL * (is_connected ? SPP_BROADCAST_PERIOD_CONNECTED_MS : SPP_BROADCAST_PERIOD_MS);
+    bool due;
+    portENTER_CRITICAL(&bcast_mux);
+    due = bcast.dirty && ((esp_timer_get_time() - bcast.last_us) >= period_us);
+    portEXIT_CRITICAL(&bcast_mux);
+    if (due) {
+        __bcast_apply();
+    }
+}
+
+static void __bcast_init() {
+    const esp_timer_create_args_t args = {.callback = __bcast_tick, .name = "spp_bcast"};
+    ESP_ERROR_CHECK(esp_timer_create(&args, &bcast.timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(bcast.timer, 1000ULL * SPP_BROADCAST_PERIOD_MS));
+    __bcast_apply();
+}
+
+esp_err_t ble_spp_broadcast_update(const uint8_t *buf, size_t len) {
+    if (len > SPP_BROADCAST_MAX_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    portENTER_CRITICAL(&bcast_mux);
+    memcpy(bcast.rec, buf, len);
+    bcast.len = len;
+    bcast.dirty = true;
+    portEXIT_CRITICAL(&bcast_mux);
+    return ESP_OK;
+}
+#else
+esp_err_t ble_spp_broadcast_update(const uint8_t *buf, size_t len) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+#endif
+
+/*Advertising scheduler. Without a central the stages of SPP_ADV_STAGES run one after the other, each (re)started
+  from ADV_STOP_COMPLETE when the stage timer fires. After a disconnect a bonded peer gets SPP_ADV_DIRECTED_MS of
+  high duty directed advertising first. In broadcast mode scannable advertising continues while connected.
+  adv_active is set when a start is requested, so data updates landing before ADV_START_COMPLETE don't start twice.*/
+#define SPP_ADV_STAGE_DIRECTED (-1)
+typedef struct {
+    uint16_t int_min;
+    uint16_t int_max;
+    uint32_t duration_ms;
+} spp_adv_stage_t;
+static const spp_adv_stage_t adv_stages[] = SPP_ADV_STAGES;
+#define SPP_ADV_STAGE_NUM ((int)(sizeof(adv_stages) / sizeof(adv_stages[0])))
+static bool adv_active = false;
+static struct {
+    int stage;
+    int64_t down_us; /*Disconnect time, 0 before the first connection*/
+    esp_timer_handle_t timer;
+    bool peer_bonded; /*Current peer completed pairing or encryption, identity below*/
+    esp_bd_addr_t peer_addr;
+    esp_ble_addr_type_t peer_addr_type;
+    uint32_t reconnects;
+    uint32_t last_ms;
+    uint32_t worst_ms;
+} adv_sched;
+
+static void __adv_start() {
+    esp_ble_adv_params_t params = spp_adv_params;
+    uint32_t duration_ms;
+    if (adv_active) {
+        return;
+    }
+    if (is_connected) {
+#if (SPP_BROADCAST_ENABLE == 1)
+        adv_active = true;
+        esp_ble_gap_start_advertising(&bcast_adv_params);
+#endif
+        return;
+    }
+    if (SPP_ADV_STAGE_DIRECTED == adv_sched.stage) {
+        params.adv_type = ADV_TYPE_DIRECT_IND_HIGH;
+        memcpy(params.peer_addr, adv_sched.peer_addr, sizeof(esp_bd_addr_t));
+        params.peer_addr_type = adv_sched.peer_addr_type;
+        duration_ms = SPP_ADV_DIRECTED_MS;
+    } else {
+        params.adv_int_min = adv_stages[adv_sched.stage].int_min;
+        params.adv_int_max = adv_stages[adv_sched.stage].int_max;
+        duration_ms = adv_stages[adv_sched.stage].duration_ms;
+    }
+    SPP_TRACE(SPP_TRACE_ADV_STAGE, (uint8_t)adv_sched.stage, 0);
+    adv_active = true;
+    esp_ble_gap_start_advertising(&params);
+    esp_timer_stop(adv_sched.timer);
+    if (duration_ms > 0) {
+        esp_timer_start_once(adv_sched.timer, 1000ULL * duration_ms);
+    }
+}
+
+static void __adv_next_stage(void *arg) {
+    if (is_connected || (adv_sched.stage >= (SPP_ADV_STAGE_NUM - 1))) {
+        return;
+    }
+    adv_sched.stage++;
+    /*Restarted with the new interval from ADV_STOP_COMPLETE, also when directed advertising already timed out*/
+    esp_ble_gap_stop_advertising();
+}
+
+static void __adv_sched_init() {
+    const esp_timer_create_args_t args = {.callback = __adv_next_stage, .name = "spp_adv"};
+    ESP_ERROR_CHECK(esp_timer_create(&args, &adv_sched.timer));
+    adv_sched.stage = 0;
+}
+
+static void __adv_on_connect() {
+    esp_timer_stop(adv_sched.timer);
+    adv_active = false;
+    if (adv_sched.down_us > 0) {
+        adv_sched.last_ms = (uint32_t)((esp_timer_get_time() - adv_sched.down_us) / 1000);
+        adv_sched.worst_ms = (adv_sched.last_ms > adv_sched.worst_ms) ? adv_sched.last_ms : adv_sched.worst_ms;
+        adv_sched.reconnects++;
+        SPP_TRACE(SPP_TRACE_RECONNECT, (uint8_t)adv_sched.stage, (adv_sched.last_ms > 0xffff) ? 0xffff : adv_sched.last_ms);
+        ESP_LOGI(GATTS_TABLE_TAG, "Reconnected after %u ms in advertising stage %d, worst %u ms over %u reconnects", (unsigned)adv_sched.last_ms,
+                 adv_sched.stage, (unsigned)adv_sched.worst_ms, (unsigned)adv_sched.reconnects);
+    }
+    adv_sched.peer_bonded = false;
+}
+
+static void __adv_on_disconnect() {
+    bool directed = (SPP_ADV_DIRECTED_MS > 0) && adv_sched.peer_bonded;
+    adv_sched.down_us = esp_timer_get_time();
+    adv_sched.stage = directed ? SPP_ADV_STAGE_DIRECTED : 0;
+    if (adv_active) {
+        /*Scannable broadcast is running, restart it from ADV_STOP_COMPLETE*/
+        esp_ble_gap_stop_advertising();
+        return;
+    }
+    __adv_start();
+}
+
+/*Session of a bonded peer, keyed by its identity address: restored once pairing or encryption completes and saved on disconnect,
+  see spp_session.h. Only turns things on, what the client already set on this connection stays.
+  The MTU is only reported, ATT MTU is per connection and the stack drops notifications above the exchanged one.*/
+static void __session_restore() {
+    spp_session_t sess;
+    if (!is_connected || !adv_sched.peer_bonded || !spp_session_load(adv_sched.peer_addr, &sess)) {
+        return;
+    }
+    enable_data_ntf |= (sess.flags & SPP_SESSION_DATA_NTF) != 0;
+#ifdef SUPPORT_HEARTBEAT
+    enable_heart_ntf |= (sess.flags & SPP_SESSION_HEART_NTF) != 0;
+#endif
+#if (SPP_RELIABLE_UPLINK == 1)
+    /*The window is gone, the client sees the new sequence space start*/
+    if (sess.flags & SPP_SESSION_RELIABLE) {
+        rel.enable_req = true;
+        ESP_LOGI(GATTS_TABLE_TAG, "Reliable uplink restarts, client had acknowledged %u", sess.rel_acked);
+    }
+#endif
+#if (SPP_PULL_UPLINK == 1)
+    if (sess.flags & SPP_SESSION_PULL) {
+        pull.enable_req = true;
+    }
+#endif
+    ESP_LOGI(GATTS_TABLE_TAG, "Session restored, flags 0x%x, last MTU %u", sess.flags, sess.mtu);
+    /*Whatever waits in the uplink goes out without waiting for the client*/
+    __release_ble_uplink();
+}
+
+static void __session_save() {
+    spp_session_t sess = {.version = SPP_SESSION_VERSION, .mtu = spp_mtu_size};
+    if (!adv_sched.peer_bonded) {
+        return;
+    }
+    sess.flags |= enable_data_ntf ? SPP_SESSION_DATA_NTF : 0;
+#ifdef SUPPORT_HEARTBEAT
+    sess.flags |= enable_heart_ntf ? SPP_SESSION_HEART_NTF : 0;
+#endif
+#if (SPP_RELIABLE_UPLINK == 1)
+    if (rel.enabled) {
+        sess.flags |= SPP_SESSION_RELIABLE;
+        sess.rel_acked = rel.base - 1;
+    }
+#endif
+#if (SPP_PULL_UPLINK == 1)
+    sess.flags |= pull.enabled ? SPP_SESSION_PULL : 0;
+#endif
+    spp_session_store(adv_sched.peer_addr, &sess);
+}
 
 void link_task(void *pvParameters) {
 
     size_t linesize;
+    size_t chunk;
     uint8_t total_num = 0;
     uint8_t current_num = 0;
     uint8_t temp[UPLINK_BUFSIZE];
 
     for (;;) {
         //Waiting for UART event.
-        if (xSemaphoreTake(__enable_tx_sem, portMAX_DELAY) == pdPASS) {
+        if (xSemaphoreTake(__enable_tx_sem, __rel_wait_ticks()) == pdPASS) {
+#if (SPP_RELIABLE_UPLINK == 1)
+            __rel_apply_enable();
+            if (rel.resend_req) {
+                __rel_retransmit();
+            }
+#endif
+#if (SPP_PULL_UPLINK == 1)
+            __pull_apply_enable();
+#endif
             if (is_connected) {
                 memset(temp, 0, UPLINK_BUFSIZE);
                 linesize = (__my_get_uplink_len_cb != NULL) ? (__my_get_uplink_len_cb()) : 0;
+                SPP_TRACE(SPP_TRACE_TX_WAKEUP, 0, linesize);
+#if (SPP_PULL_UPLINK == 1)
+                /*Left in the uplink for the client to read*/
+                if (pull.enabled) {
+                    continue;
+                }
+#endif
 #if (BLE_SPP_DBG == 1)
-                ESP_LOGI(GATTS_TABLE_TAG, "Linesize :%d", linesize);
+                ESP_LOGI(GATTS_TABLE_TAG, "Linesize :%d", (int)linesize);
 #endif
-                uint8_t *ntf_value_p = NULL;
+                uint8_t *ntf_value_p = ntf_value;
 #ifdef SUPPORT_HEARTBEAT
                 if (!enable_heart_ntf) {
-                    ESP_LOGE(GATTS_TABLE_TAG, "%s do not enable heartbeat Notify\n", __func__);
-                    break;
+#if (BLE_SPP_DBG == 1)
+                    ESP_LOGI(GATTS_TABLE_TAG, "%s do not enable heartbeat Notify\n", __func__);
+#endif
+                    continue;
                 }
 #endif
+                /*Left in the uplink, enabling the CCCD releases it*/
                 if (!enable_data_ntf) {
-                    ESP_LOGE(GATTS_TABLE_TAG, "%s do not enable data Notify\n", __func__);
-                    break;
+#if (BLE_SPP_DBG == 1)
+                    ESP_LOGI(GATTS_TABLE_TAG, "%s do not enable data Notify\n", __func__);
+#endif
+                    continue;
                 }
                 if (linesize > 0 && linesize < UPLINK_BUFSIZE) {
                     if (NULL != __my_read_cb) {
                         __my_read_cb(temp, linesize, portMAX_DELAY);
 #if (BLE_SPP_DBG == 1)
-                        ESP_LOGI(GATTS_TABLE_TAG, "TX :%s", temp);
+                        ESP_LOG_BUFFER_HEXDUMP(GATTS_TABLE_TAG, temp, linesize, ESP_LOG_INFO);
 #endif
                     }
-                    if (linesize <= (spp_mtu_size - 3)) {
-                        esp_ble_gatts_send_indicate(spp_gatts_if, spp_conn_id, spp_handle_table[SPP_IDX_SPP_DATA_NTY_VAL], linesize, temp, false);
-                    } else if (linesize > (spp_mtu_size - 3)) {
+#if (SPP_RELIABLE_UPLINK == 1)
+                    if (rel.enabled) {
+                        __rel_send(temp, linesize);
+                        SPP_TRACE(SPP_TRACE_TX_DONE, 0, linesize);
+                        continue;
+                    }
+#endif
+                    if (raw_uplink || (linesize <= (spp_mtu_size - 3))) {
+                        /*Records carry their own length prefix, the stream goes out in plain notifications without a fragment header*/
+                        current_num = 1;
+                        for (size_t off = 0; off < linesize; off += chunk, current_num++) {
+                            chunk = ((linesize - off) < (spp_mtu_size - 3)) ? (linesize - off) : (spp_mtu_size - 3);
+                            while (is_congested && is_connected) {
+                                vTaskDelay(1);
+                            }
+                            esp_ble_gatts_send_indicate(spp_gatts_if, spp_conn_id, spp_handle_table[SPP_IDX_SPP_DATA_NTY_VAL], chunk, temp + off, false);
+                            SPP_TRACE(SPP_TRACE_TX_FRAGMENT, current_num, chunk);
+                        }
+                    } else {
                         if ((linesize % (spp_mtu_size - 7)) == 0) {
                             total_num = linesize / (spp_mtu_size - 7);
                         } else {
                             total_num = linesize / (spp_mtu_size - 7) + 1;
                         }
                         current_num = 1;
-                        ntf_value_p = (uint8_t *)malloc((spp_mtu_size - 3) * sizeof(uint8_t));
-                        if (ntf_value_p == NULL) {
-                            ESP_LOGE(GATTS_TABLE_TAG, "%s malloc.2 failed\n", __func__);
-                            break;
-                        }
                         while (current_num <= total_num) {
                             if (current_num < total_num) {
                                 ntf_value_p[0] = '#';
@@ -349,6 +993,7 @@ void link_task(void *pvParameters) {
                                 ntf_value_p[3] = current_num;
                                 memcpy(ntf_value_p + 4, temp + (current_num - 1) * (spp_mtu_size - 7), (spp_mtu_size - 7));
                                 esp_ble_gatts_send_indicate(spp_gatts_if, spp_conn_id, spp_handle_table[SPP_IDX_SPP_DATA_NTY_VAL], (spp_mtu_size - 3), ntf_value_p, false);
+                                SPP_TRACE(SPP_TRACE_TX_FRAGMENT, current_num, (spp_mtu_size - 3));
                             } else if (current_num == total_num) {
                                 ntf_value_p[0] = '#';
                                 ntf_value_p[1] = '#';
@@ -356,15 +1001,23 @@ void link_task(void *pvParameters) {
                                 ntf_value_p[3] = current_num;
                                 memcpy(ntf_value_p + 4, temp + (current_num - 1) * (spp_mtu_size - 7), (linesize - (current_num - 1) * (spp_mtu_size - 7)));
                                 esp_ble_gatts_send_indicate(spp_gatts_if, spp_conn_id, spp_handle_table[SPP_IDX_SPP_DATA_NTY_VAL], (linesize - (current_num - 1) * (spp_mtu_size - 7) + 4), ntf_value_p, false);
+                                SPP_TRACE(SPP_TRACE_TX_FRAGMENT, current_num, (linesize - (current_num - 1) * (spp_mtu_size - 7) + 4));
                             }
                             vTaskDelay(20 / portTICK_PERIOD_MS);
                             current_num++;
                         }
-                        free(ntf_value_p);
                     }
+                    SPP_TRACE(SPP_TRACE_TX_DONE, 0, linesize);
                 }
             }
         }
+#if (SPP_RELIABLE_UPLINK == 1)
+        else {
+            /*Nothing new to send but the window is stuck, resend it. A disconnect in between dropped it*/
+            __rel_apply_enable();
+            __rel_retransmit();
+        }
+#endif
     }
     ESP_LOGW(GATTS_TABLE_TAG, "Killing BT link task");
     vTaskDelete(NULL);
@@ -396,42 +1049,98 @@ void spp_heartbeat_task(void *arg) {
 #endif
 
 void spp_cmd_task(void *arg) {
-    uint8_t *cmd_id;
+    spp_cmd_t cmd;
 
     for (;;) {
         vTaskDelay(50 / portTICK_PERIOD_MS);
-        if (xQueueReceive(cmd_cmd_queue, &cmd_id, portMAX_DELAY)) {
-            esp_log_buffer_char(GATTS_TABLE_TAG, (char *)(cmd_id), strlen((char *)cmd_id));
-            free(cmd_id);
+        if (xQueueReceive(cmd_cmd_queue, &cmd, portMAX_DELAY)) {
+            esp_log_buffer_char(GATTS_TABLE_TAG, (char *)(cmd.data), cmd.len);
+            if (0 == strncmp((char *)cmd.data, SPP_CMD_TRACE_DUMP, strlen(SPP_CMD_TRACE_DUMP))) {
+                spp_trace_dump();
+            } else if (0 == strncmp((char *)cmd.data, SPP_CMD_MEM_REPORT, strlen(SPP_CMD_MEM_REPORT))) {
+                ble_spp_mem_report();
+            } else if (0 == strncmp((char *)cmd.data, SPP_CMD_CAPTURE_DUMP, strlen(SPP_CMD_CAPTURE_DUMP))) {
+                spp_capture_dump();
+            } else if (0 == strncmp((char *)cmd.data, SPP_CMD_BOOT_REPORT, strlen(SPP_CMD_BOOT_REPORT))) {
+                ble_spp_boot_report();
+            } else if (0 == strncmp((char *)cmd.data, SPP_CMD_DELTA_REPORT, strlen(SPP_CMD_DELTA_REPORT))) {
+                spp_delta_report();
+            }
+#if (SPP_RELIABLE_UPLINK == 1)
+            else if (0 == strncmp((char *)cmd.data, SPP_CMD_REL_ON, strlen(SPP_CMD_REL_ON))) {
+                rel.enable_req = true;
+                __release_ble_uplink();
+            } else if (0 == strncmp((char *)cmd.data, SPP_CMD_REL_OFF, strlen(SPP_CMD_REL_OFF))) {
+                rel.enable_req = false;
+                __release_ble_uplink();
+            }
+#endif
+#if (SPP_PULL_UPLINK == 1)
+            else if (0 == strncmp((char *)cmd.data, SPP_CMD_PULL_ON, strlen(SPP_CMD_PULL_ON))) {
+                pull.enable_req = true;
+                __release_ble_uplink();
+            } else if (0 == strncmp((char *)cmd.data, SPP_CMD_PULL_OFF, strlen(SPP_CMD_PULL_OFF))) {
+                pull.enable_req = false;
+                __release_ble_uplink();
+            }
+#endif
         }
     }
     vTaskDelete(NULL);
 }
 
 static void spp_task_init(void) {
-    xTaskCreate(link_task, "linkTask", 4096, NULL, 8, NULL);
+    link_task_handle = SPP_TASK_CREATE(link_task, "linkTask", SPP_LINK_TASK_STACK, SPP_LINK_TASK_PRIO);
+    MY_ASSERT_NOT(link_task_handle, NULL);
 
 #ifdef SUPPORT_HEARTBEAT
-    cmd_heartbeat_queue = xQueueCreate(10, sizeof(uint32_t));
-    xTaskCreate(spp_heartbeat_task, "spp_heartbeat_task", 2048, NULL, 10, NULL);
+    cmd_heartbeat_queue = SPP_QUEUE_CREATE(SPP_HEARTBEAT_QUEUE_LEN, sizeof(uint32_t));
+    MY_ASSERT_NOT(cmd_heartbeat_queue, NULL);
+    heartbeat_task_handle = SPP_TASK_CREATE(spp_heartbeat_task, "spp_heartbeat_task", SPP_HEARTBEAT_TASK_STACK, SPP_HEARTBEAT_TASK_PRIO);
+    MY_ASSERT_NOT(heartbeat_task_handle, NULL);
 #endif
 
-    cmd_cmd_queue = xQueueCreate(10, sizeof(uint32_t));
-    xTaskCreate(spp_cmd_task, "spp_cmd_task", 2048, NULL, 10, NULL);
+    cmd_cmd_queue = SPP_QUEUE_CREATE(SPP_CMD_QUEUE_LEN, sizeof(spp_cmd_t));
+    MY_ASSERT_NOT(cmd_cmd_queue, NULL);
+    cmd_task_handle = SPP_TASK_CREATE(spp_cmd_task, "spp_cmd_task", SPP_CMD_TASK_STACK, SPP_CMD_TASK_PRIO);
+    MY_ASSERT_NOT(cmd_task_handle, NULL);
 }
 
 static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) {
     esp_err_t err;
-    ESP_LOGE(GATTS_TABLE_TAG, "GAP_EVT, event %d\n", event);
+#if (BLE_SPP_DBG == 1)
+    ESP_LOGI(GATTS_TABLE_TAG, "GAP_EVT, event %d\n", event);
+#endif
 
     switch (event) {
     case ESP_GAP_BLE_ADV_DATA_RAW_SET_COMPLETE_EVT:
-        esp_ble_gap_start_advertising(&spp_adv_params);
+        __adv_start();
         break;
     case ESP_GAP_BLE_ADV_START_COMPLETE_EVT:
         //advertising start complete event to indicate advertising start successfully or failed
         if ((err = param->adv_start_cmpl.status) != ESP_BT_STATUS_SUCCESS) {
             ESP_LOGE(GATTS_TABLE_TAG, "Advertising start failed: %s\n", esp_err_to_name(err));
+            adv_active = false;
+        } else if (0 == boot_us[SPP_BOOT_ADV_START]) {
+            ble_spp_boot_mark(SPP_BOOT_ADV_START);
+            ble_spp_boot_report();
+        }
+        break;
+    case ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT:
+        /*Only stopped to change advertising stage or type*/
+        adv_active = false;
+        __adv_start();
+        break;
+    case ESP_GAP_BLE_REMOVE_BOND_DEV_COMPLETE_EVT:
+        spp_session_forget(param->remove_bond_dev_cmpl.bd_addr);
+        break;
+    case ESP_GAP_BLE_AUTH_CMPL_EVT:
+        /*Remember the identity of a bonded peer for directed advertising after it drops*/
+        if (param->ble_security.auth_cmpl.success) {
+            adv_sched.peer_bonded = true;
+            memcpy(adv_sched.peer_addr, param->ble_security.auth_cmpl.bd_addr, sizeof(esp_bd_addr_t));
+            adv_sched.peer_addr_type = param->ble_security.auth_cmpl.addr_type;
+            __session_restore();
         }
         break;
     default:
@@ -442,22 +1151,34 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param
 static void gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param) {
     esp_ble_gatts_cb_param_t *p_data = (esp_ble_gatts_cb_param_t *)param;
     uint8_t res = 0xff;
+    SPP_TRACE(SPP_TRACE_GATTS_EVT, 0, event);
 #if (BLE_SPP_DBG == 1)
     ESP_LOGI(GATTS_TABLE_TAG, "event = %x\n", event);
 #endif
     switch (event) {
     case ESP_GATTS_REG_EVT:
+        ble_spp_boot_mark(SPP_BOOT_REG_EVT);
         ESP_LOGI(GATTS_TABLE_TAG, "%s %d\n", __func__, __LINE__);
         esp_ble_gap_set_device_name(SAMPLE_DEVICE_NAME);
 
         ESP_LOGI(GATTS_TABLE_TAG, "%s %d\n", __func__, __LINE__);
+        __adv_sched_init();
+#if (SPP_BROADCAST_ENABLE == 1)
+        __bcast_init();
+#else
         esp_ble_gap_config_adv_data_raw((uint8_t *)spp_adv_data, sizeof(spp_adv_data));
+#endif
 
         ESP_LOGI(GATTS_TABLE_TAG, "%s %d\n", __func__, __LINE__);
         esp_ble_gatts_create_attr_tab(spp_gatt_db, gatts_if, SPP_IDX_NB, SPP_SVC_INST_ID);
         break;
     case ESP_GATTS_READ_EVT:
         res = find_char_and_desr_index(p_data->read.handle);
+#if (SPP_PULL_UPLINK == 1)
+        if (res == SPP_IDX_SPP_DATA_NTY_VAL) {
+            __pull_read(gatts_if, p_data);
+        }
+#endif
         if (res == SPP_IDX_SPP_STATUS_VAL) {
             //TODO:client read the status characteristic
         }
@@ -469,18 +1190,21 @@ static void gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_
             ESP_LOGI(GATTS_TABLE_TAG, "ESP_GATTS_WRITE_EVT : handle = %d\n", res);
 #endif
             if (res == SPP_IDX_SPP_COMMAND_VAL) {
-                uint8_t *spp_cmd_buff = NULL;
-                spp_cmd_buff = (uint8_t *)malloc((spp_mtu_size - 3) * sizeof(uint8_t));
-                if (spp_cmd_buff == NULL) {
-                    ESP_LOGE(GATTS_TABLE_TAG, "%s malloc failed\n", __func__);
+#if (SPP_RELIABLE_UPLINK == 1)
+                /*Acks are handled here and not in spp_cmd_task to keep the window moving*/
+                if ((p_data->write.len == SPP_REL_ACK_LEN) && (p_data->write.value[0] == 'A') && (p_data->write.value[1] == 'K')) {
+                    __rel_ack(p_data->write.value[2] | (p_data->write.value[3] << 8));
                     break;
                 }
-                memset(spp_cmd_buff, 0x0, (spp_mtu_size - 3));
-                memcpy(spp_cmd_buff, p_data->write.value, p_data->write.len);
-                xQueueSend(cmd_cmd_queue, &spp_cmd_buff, 10 / portTICK_PERIOD_MS);
+#endif
+                spp_cmd_t cmd = {0};
+                cmd.len = (p_data->write.len < SPP_CMD_MAX_LEN) ? p_data->write.len : SPP_CMD_MAX_LEN;
+                memcpy(cmd.data, p_data->write.value, cmd.len);
+                xQueueSend(cmd_cmd_queue, &cmd, 10 / portTICK_PERIOD_MS);
             } else if (res == SPP_IDX_SPP_DATA_NTF_CFG) {
                 if ((p_data->write.len == 2) && (p_data->write.value[0] == 0x01) && (p_data->write.value[1] == 0x00)) {
                     enable_data_ntf = true;
+                    __release_ble_uplink();
                 } else if ((p_data->write.len == 2) && (p_data->write.value[0] == 0x00) && (p_data->write.value[1] == 0x00)) {
                     enable_data_ntf = false;
                 }
@@ -502,11 +1226,12 @@ static void gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_
 #ifdef SPP_DEBUG_MODE
                 esp_log_buffer_char(GATTS_TABLE_TAG, (char *)(p_data->write.value), p_data->write.len);
 #else
+                SPP_TRACE(SPP_TRACE_RX_WRITE, 0, p_data->write.len);
                 if (NULL != __my_write_cb) {
                     __my_write_cb((char *)(p_data->write.value), (size_t)p_data->write.len);
 /*My write cb will append termination character after newline*/
 #if (BLE_SPP_DBG == 1)
-                    ESP_LOGI(GATTS_TABLE_TAG, "spp len %d:%s", p_data->write.len, p_data->write.value);
+                    ESP_LOG_BUFFER_HEXDUMP(GATTS_TABLE_TAG, p_data->write.value, p_data->write.len, ESP_LOG_INFO);
 #endif
                 }
 #endif
@@ -534,6 +1259,14 @@ static void gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_
         spp_mtu_size = p_data->mtu.mtu;
         break;
     case ESP_GATTS_CONF_EVT:
+#if (SPP_RELIABLE_UPLINK == 1)
+        /*A notification the stack could not send, resend the window without waiting for the timeout*/
+        if (rel.enabled && (p_data->conf.status != ESP_GATT_OK) && (p_data->conf.handle == spp_handle_table[SPP_IDX_SPP_DATA_NTY_VAL])) {
+            SPP_TRACE(SPP_TRACE_TX_ERROR, 1, p_data->conf.status);
+            rel.resend_req = true;
+            xSemaphoreGive(rel_ack_sem);
+        }
+#endif
         break;
     case ESP_GATTS_UNREG_EVT:
         break;
@@ -548,19 +1281,33 @@ static void gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_
         spp_gatts_if = gatts_if;
         is_connected = true;
         memcpy(&spp_remote_bda, &p_data->connect.remote_bda, sizeof(esp_bd_addr_t));
+        /*The connection ended connectable advertising, in broadcast mode keep going as scannable*/
+        __adv_on_connect();
+        __adv_start();
+        /*A new client has none of the dictionaries and no previous record to apply deltas to*/
+        spp_delta_resync();
 #ifdef SUPPORT_HEARTBEAT
         uint16_t cmd = 0;
         xQueueSend(cmd_heartbeat_queue, &cmd, 10 / portTICK_PERIOD_MS);
 #endif
         break;
     case ESP_GATTS_DISCONNECT_EVT:
+        __session_save();
         is_connected = false;
+#if (SPP_RELIABLE_UPLINK == 1)
+        __rel_reset();
+#endif
+#if (SPP_PULL_UPLINK == 1)
+        __pull_reset();
+#endif
         enable_data_ntf = false;
+        spp_mtu_size = 23;
+        is_congested = false;
 #ifdef SUPPORT_HEARTBEAT
         enable_heart_ntf = false;
         heartbeat_count_num = 0;
 #endif
-        esp_ble_gap_start_advertising(&spp_adv_params);
+        __adv_on_disconnect();
         break;
     case ESP_GATTS_OPEN_EVT:
         break;
@@ -571,6 +1318,17 @@ static void gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_
     case ESP_GATTS_LISTEN_EVT:
         break;
     case ESP_GATTS_CONGEST_EVT:
+        SPP_TRACE(SPP_TRACE_CONGEST, 0, p_data->congest.congested);
+        is_congested = p_data->congest.congested;
+#if (SPP_RELIABLE_UPLINK == 1)
+        if (!is_congested) {
+            /*Wakes __rel_send or link_task for the resend deferred while congested*/
+            xSemaphoreGive(rel_ack_sem);
+            if (rel.resend_req) {
+                __release_ble_uplink();
+            }
+        }
+#endif
         break;
     case ESP_GATTS_CREAT_ATTR_TAB_EVT: {
         ESP_LOGI(GATTS_TABLE_TAG, "The number handle =%x\n", param->add_attr_tab.num_handle);
@@ -580,6 +1338,7 @@ static void gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_
             ESP_LOGE(GATTS_TABLE_TAG, "Create attribute table abnormally, num_handle (%d) doesn't equal to HRS_IDX_NB(%d)", param->add_attr_tab.num_handle, SPP_IDX_NB);
         } else {
             memcpy(spp_handle_table, param->add_attr_tab.handles, sizeof(spp_handle_table));
+            ble_spp_boot_mark(SPP_BOOT_ATTR_TAB);
             esp_ble_gatts_start_service(spp_handle_table[SPP_IDX_SVC]);
         }
         break;
@@ -621,8 +1380,16 @@ static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_
 */
 ble_spp_relase_uplink_t setup_ble_spp() {
     esp_err_t ret;
-    __enable_tx_sem = xSemaphoreCreateBinary();
+    __enable_tx_sem = SPP_BINARY_SEMAPHORE_CREATE();
     MY_ASSERT_NOT(__enable_tx_sem, NULL);
+#if (SPP_RELIABLE_UPLINK == 1)
+    rel_ack_sem = SPP_BINARY_SEMAPHORE_CREATE();
+    MY_ASSERT_NOT(rel_ack_sem, NULL);
+#endif
+#if (SPP_PULL_UPLINK == 1)
+    pull_lock = SPP_MUTEX_CREATE();
+    MY_ASSERT_NOT(pull_lock, NULL);
+#endif
     esp_bt_controller_config_t bt_cfg = BT_CONTROLLER_INIT_CONFIG_DEFAULT();
 
     // Initialize NVS
@@ -632,6 +1399,8 @@ ble_spp_relase_uplink_t setup_ble_spp() {
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    spp_session_init();
+    ble_spp_boot_mark(SPP_BOOT_NVS);
 
     ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT));
 
@@ -641,29 +1410,37 @@ ble_spp_relase_uplink_t setup_ble_spp() {
         return SPP_ERROR_INIT;
     }
 
+    ble_spp_boot_mark(SPP_BOOT_CTRL_INIT);
+
     ret = esp_bt_controller_enable(ESP_BT_MODE_BLE);
     if (ret) {
         ESP_LOGE(GATTS_TABLE_TAG, "%s enable controller failed: %s\n", __func__, esp_err_to_name(ret));
         return SPP_ERROR_INIT;
     }
 
+    ble_spp_boot_mark(SPP_BOOT_CTRL_ENABLE);
+
     ESP_LOGI(GATTS_TABLE_TAG, "%s init bluetooth\n", __func__);
     ret = esp_bluedroid_init();
     if (ret) {
         ESP_LOGE(GATTS_TABLE_TAG, "%s init bluetooth failed: %s\n", __func__, esp_err_to_name(ret));
         return SPP_ERROR_INIT;
     }
+    ble_spp_boot_mark(SPP_BOOT_BLUEDROID_INIT);
     ret = esp_bluedroid_enable();
     if (ret) {
         ESP_LOGE(GATTS_TABLE_TAG, "%s enable bluetooth failed: %s\n", __func__, esp_err_to_name(ret));
         return SPP_ERROR_INIT;
     }
 
+    ble_spp_boot_mark(SPP_BOOT_BLUEDROID_ENABLE);
+
     esp_ble_gatts_register_callback(gatts_event_handler);
     esp_ble_gap_register_callback(gap_event_handler);
     esp_ble_gatts_app_register(ESP_SPP_APP_ID);
 
     spp_task_init();
+    ble_spp_boot_mark(SPP_BOOT_APP_REGISTER);
 
     return __release_ble_uplink;
 }
@@ -681,6 +1458,79 @@ void register_get_uplink_len_callback(ble_spp_get_txlen_t sizeofbuf_cb) {
     __my_get_uplink_len_cb = sizeofbuf_cb;
 }
 
+void ble_spp_set_raw_uplink(bool raw) {
+    raw_uplink = raw;
+}
+
 static void __release_ble_uplink() {
-    MY_ASSERT_EQ(xSemaphoreGive(__enable_tx_sem), pdPASS);
+    /*A wakeup already pending covers this line too, link_task drains the whole uplink*/
+    xSemaphoreGive(__enable_tx_sem);
+}
+
+void ble_spp_boot_mark(spp_boot_phase_t phase) {
+    if (0 == boot_us[phase]) {
+        boot_us[phase] = esp_timer_get_time();
+    }
+}
+
+static int64_t __boot_key(uint8_t phase) {
+    return (0 == boot_us[phase]) ? INT64_MAX : boot_us[phase];
+}
+
+/*Phases in the order they were reached, with the time spent since the one before, unreached ones last*/
+void ble_spp_boot_report() {
+    uint8_t order[SPP_BOOT_PHASE_NUM];
+    uint8_t n = 0;
+    int64_t prev = 0;
+    for (uint8_t i = 0; i < SPP_BOOT_PHASE_NUM; i++) {
+        uint8_t j = n++;
+        for (; (j > 0) && (__boot_key(order[j - 1]) > __boot_key(i)); j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+    ESP_LOGI(GATTS_TABLE_TAG, "Startup profile, us since boot (+us since previous phase), async init %s", (SPP_ASYNC_INIT == 1) ? "on" : "off");
+    for (uint8_t i = 0; i < SPP_BOOT_PHASE_NUM; i++) {
+        if (0 == boot_us[order[i]]) {
+            ESP_LOGI(GATTS_TABLE_TAG, "%-18s not reached", boot_phase_name[order[i]]);
+            continue;
+        }
+        ESP_LOGI(GATTS_TABLE_TAG, "%-18s %9u (+%u)", boot_phase_name[order[i]], (unsigned)boot_us[order[i]], (unsigned)(boot_us[order[i]] - prev));
+        prev = boot_us[order[i]];
+    }
+}
+
+static void __stack_report(const char *name, TaskHandle_t handle, uint32_t stack) {
+    uint32_t free_bytes;
+    if (NULL == handle) {
+        return;
+    }
+    free_bytes = uxTaskGetStackHighWaterMark(handle);
+    ESP_LOGI(GATTS_TABLE_TAG, "%-20s stack %5u min free %5u", name, (unsigned)stack, (unsigned)free_bytes);
+    if (free_bytes < SPP_STACK_MIN_FREE) {
+        ESP_LOGE(GATTS_TABLE_TAG, "%s stack nearly exhausted, raise its size in spp_config.h", name);
+    } else if ((free_bytes * 100) > (stack * SPP_STACK_OVERSIZE_PCT)) {
+        ESP_LOGW(GATTS_TABLE_TAG, "%s stack oversized, %u bytes never used", name, (unsigned)free_bytes);
+    }
+}
+
+/*Prints the static RAM budget of the link and the stack high water marks of its tasks.
+  High water marks only mean something after the link has carried representative traffic.*/
+void ble_spp_mem_report() {
+    ESP_LOGI(GATTS_TABLE_TAG, "Static allocation %s", (SPP_STATIC_ALLOCATION == 1) ? "on" : "off");
+    ESP_LOGI(GATTS_TABLE_TAG, "console_ll %5u bytes", (unsigned)SPP_STATIC_RAM_CONSOLE);
+    ESP_LOGI(GATTS_TABLE_TAG, "server     %5u bytes", (unsigned)SPP_STATIC_RAM_SERVER);
+    ESP_LOGI(GATTS_TABLE_TAG, "fragment   %5u bytes", (unsigned)SPP_NTF_BUF_LEN);
+    ESP_LOGI(GATTS_TABLE_TAG, "trace      %5u bytes", (unsigned)SPP_STATIC_RAM_TRACE);
+    ESP_LOGI(GATTS_TABLE_TAG, "reliable   %5u bytes", (unsigned)SPP_STATIC_RAM_REL);
+    ESP_LOGI(GATTS_TABLE_TAG, "pull       %5u bytes", (unsigned)SPP_STATIC_RAM_PULL);
+    ESP_LOGI(GATTS_TABLE_TAG, "capture    %5u bytes", (unsigned)SPP_STATIC_RAM_CAPTURE);
+    ESP_LOGI(GATTS_TABLE_TAG, "broadcast  %5u bytes", (unsigned)SPP_STATIC_RAM_BCAST);
+    ESP_LOGI(GATTS_TABLE_TAG, "delta      %5u bytes", (unsigned)SPP_STATIC_RAM_DELTA);
+    ESP_LOGI(GATTS_TABLE_TAG, "total      %5u of %u bytes budget", (unsigned)SPP_STATIC_RAM_TOTAL, (unsigned)SPP_STATIC_RAM_BUDGET);
+    __stack_report("linkTask", link_task_handle, SPP_LINK_TASK_STACK);
+    __stack_report("spp_cmd_task", cmd_task_handle, SPP_CMD_TASK_STACK);
+#ifdef SUPPORT_HEARTBEAT
+    __stack_report("spp_heartbeat_task", heartbeat_task_handle, SPP_HEARTBEAT_TASK_STACK);
+#endif
 }
@@ -23,6 +23,10 @@
 #define SPP_CMD_MAX_LEN (20)
 #define SPP_STATUS_MAX_LEN (20)
 #define SPP_DATA_BUFF_MAX_LEN (2 * 1024)
+/*Broadcast telemetry bytes carried in the advertisement and in the scan response*/
+#define SPP_BROADCAST_ADV_LEN (19)
+#define SPP_BROADCAST_RSP_LEN (10)
+#define SPP_BROADCAST_MAX_LEN (SPP_BROADCAST_ADV_LEN + SPP_BROADCAST_RSP_LEN)
 ///Attributes State Machine
 enum {
     SPP_IDX_SVC,
@@ -51,13 +55,42 @@ enum {
 };
 
 #define SPP_ERROR_INIT (NULL)
+/*Command characteristic writes are queued by value*/
+typedef struct {
+    uint8_t len;
+    uint8_t data[SPP_CMD_MAX_LEN + 1];
+} spp_cmd_t;
 typedef void (*ble_spp_write_fun_t)(const char *src, size_t size);
-typedef void (*ble_spp_read_fun_t)(uint8_t *buf, uint32_t length, TickType_t timeout);
+/*Returns the bytes read, fewer than length only if timeout ran out*/
+typedef size_t (*ble_spp_read_fun_t)(uint8_t *buf, uint32_t length, TickType_t timeout);
 typedef void (*ble_spp_relase_uplink_t)();
 typedef void (*ble_spp_new_downlink_t)(size_t num_elements);
 
 typedef size_t (*ble_spp_get_txlen_t)(void);
+/*Startup phases, stamped the first time each is reached and printed by ble_spp_boot_report()*/
+typedef enum {
+    SPP_BOOT_INIT = 0,         /*console_ll_init called*/
+    SPP_BOOT_APP_RUNNING,      /*console_ll_init returned to the application*/
+    SPP_BOOT_NVS,              /*nvs_flash_init done, erase included*/
+    SPP_BOOT_CTRL_INIT,        /*controller memory released and controller initialized*/
+    SPP_BOOT_CTRL_ENABLE,      /*controller enabled in BLE mode*/
+    SPP_BOOT_BLUEDROID_INIT,   /*bluedroid initialized*/
+    SPP_BOOT_BLUEDROID_ENABLE, /*bluedroid enabled*/
+    SPP_BOOT_APP_REGISTER,     /*callbacks registered, gatts app registration requested, tasks created*/
+    SPP_BOOT_REG_EVT,          /*gatts app registered, advertising data and attribute table requested*/
+    SPP_BOOT_ATTR_TAB,         /*attribute table created, service start requested*/
+    SPP_BOOT_ADV_START,        /*advertising on air*/
+    SPP_BOOT_PHASE_NUM,
+} spp_boot_phase_t;
 
 ble_spp_relase_uplink_t setup_ble_spp();
 void register_rw_callbacks(ble_spp_write_fun_t tx_cb, ble_spp_read_fun_t rx_cb);
 void register_get_uplink_len_callback(ble_spp_get_txlen_t sizeofbuf_cb);
+/*Uplink bytes go out as plain MTU sized notifications, no '##' fragment header, for streams that frame themselves*/
+void ble_spp_set_raw_uplink(bool raw);
+/*True once link_task has switched the connection to pull mode, PULL1 takes effect asynchronously*/
+bool ble_spp_pull_active();
+void ble_spp_mem_report();
+void ble_spp_boot_mark(spp_boot_phase_t phase);
+void ble_spp_boot_report();
+esp_err_t ble_spp_broadcast_update(const uint8_t *buf, size_t len);
@@ -2,13 +2,18 @@
 #include "esp_log.h"
 #include "esp_system.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
 #include "freertos/queue.h"
+#include "freertos/ringbuf.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "spp_config.h"
 #include <stdio.h>
 
 #define BLE_SPP_USART (UART_NUM_0)
 #define DEBUG_CONSOLE_INTERFACE 0
+#define SPP_TRACE_ENABLE 0
+#define SPP_CAPTURE_ENABLE 0
 #define MY_ASSERT_EQ(x, y)                             \
     do {                                               \
         ESP_ERROR_CHECK((x == y) ? ESP_OK : ESP_FAIL); \
@@ -18,3 +23,56 @@
     do {                                               \
         ESP_ERROR_CHECK((x != y) ? ESP_OK : ESP_FAIL); \
     } while (0)
+
+/*Object creation for the ble link, static buffers sized at the call site when SPP_STATIC_ALLOCATION is set.
+  Every expansion owns its buffers, so each macro may only be expanded once per object.*/
+#if (SPP_STATIC_ALLOCATION == 1)
+#if !defined(CONFIG_FREERTOS_SUPPORT_STATIC_ALLOCATION)
+#error "SPP_STATIC_ALLOCATION requires CONFIG_FREERTOS_SUPPORT_STATIC_ALLOCATION"
+#endif
+#define SPP_QUEUE_CREATE(len, item_size)                                         \
+    ({                                                                           \
+        static uint8_t __storage[(len) * (item_size)];                           \
+        static StaticQueue_t __ctrl;                                             \
+        xQueueCreateStatic((len), (item_size), __storage, &__ctrl);              \
+    })
+#define SPP_BINARY_SEMAPHORE_CREATE()                                            \
+    ({                                                                           \
+        static StaticSemaphore_t __ctrl;                                         \
+        xSemaphoreCreateBinaryStatic(&__ctrl);                                   \
+    })
+#define SPP_MUTEX_CREATE()                                                       \
+    ({                                                                           \
+        static StaticSemaphore_t __ctrl;                                         \
+        xSemaphoreCreateMutexStatic(&__ctrl);                                    \
+    })
+#define SPP_EVENT_GROUP_CREATE()                                                 \
+    ({                                                                           \
+        static StaticEventGroup_t __ctrl;                                        \
+        xEventGroupCreateStatic(&__ctrl);                                        \
+    })
+#define SPP_RINGBUF_CREATE(size, type)                                           \
+    ({                                                                           \
+        static uint8_t __storage[(size)] __attribute__((aligned(4)));            \
+        static StaticRingbuffer_t __ctrl;                                        \
+        xRingbufferCreateStatic((size), (type), __storage, &__ctrl);             \
+    })
+#define SPP_TASK_CREATE(fn, name, stack, prio)                                   \
+    ({                                                                           \
+        static StackType_t __stack[(stack)];                                     \
+        static StaticTask_t __tcb;                                               \
+        xTaskCreateStatic((fn), (name), (stack), NULL, (prio), __stack, &__tcb); \
+    })
+#else
+#define SPP_QUEUE_CREATE(len, item_size) xQueueCreate((len), (item_size))
+#define SPP_BINARY_SEMAPHORE_CREATE() xSemaphoreCreateBinary()
+#define SPP_MUTEX_CREATE() xSemaphoreCreateMutex()
+#define SPP_EVENT_GROUP_CREATE() xEventGroupCreate()
+#define SPP_RINGBUF_CREATE(size, type) xRingbufferCreate((size), (type))
+#define SPP_TASK_CREATE(fn, name, stack, prio)                     \
+    ({                                                             \
+        TaskHandle_t __handle = NULL;                              \
+        xTaskCreate((fn), (name), (stack), NULL, (prio), &__handle); \
+        __handle;                                                  \
+    })
+#endif
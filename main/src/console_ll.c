@@ -7,47 +7,109 @@ These functions can be used as redefined stdin and stdout FD for socket/vfs task
 #include "console_ll.h"
 #include "ble_spp_server.h"
 #include "bsp.h"
+#include "spp_capture.h"
+#include "spp_delta.h"
+#include "spp_trace.h"
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/errno.h>
 #include <sys/fcntl.h>
 #include <sys/select.h>
 #include <sys/unistd.h>
 
 #define CONSOLE_LL_DBG DEBUG_CONSOLE_INTERFACE
-#define CONSOLE_PRINT_SIZE (256)
 #define CONSOLE_LL_NEWLINE ('\n')
+#define CONSOLE_LL_EVT_TX_DRAINED (1 << 0) /*Set by the link after pulling from the uplink*/
 static const char *TAG = "console_ll";
 // static console_ll_t uart_control_struct;
 bool running = false;
 QueueHandle_t rx_queue;
 QueueHandle_t tx_queue;
+static RingbufHandle_t rx_record_ring;
+static SemaphoreHandle_t tx_lock; /*Held only while enqueueing, never while waiting for room*/
+static EventGroupHandle_t tx_events;
+static console_ll_mode_t console_mode = CONSOLE_LL_MODE_TEXT;
+static console_ll_tx_policy_t tx_policy = CONSOLE_LL_TX_DROP_OLDEST;
+static TickType_t tx_policy_ticks = 0;
+static console_ll_tx_stats_t tx_stats;
+static uint32_t rx_dropped = 0; /*Downlink bytes that found the application's queue full*/
+#if (SPP_TRACE_ENABLE == 1)
+static size_t tx_unreleased = 0; /*Bytes enqueued since the last TX_ENQUEUE trace, under tx_lock*/
+#endif
+static console_ll_rx_record_t rx_record;
 
 static void __link_rx(const char *src, size_t size);
-static void __link_tx(uint8_t *buf, uint32_t length, TickType_t ticks_to_wait);
+static size_t __link_tx(uint8_t *buf, uint32_t length, TickType_t ticks_to_wait);
 static size_t __get_tx_queue_len();
 static size_t __get_rx_queue_len();
+static void __link_rx_record(const char *src, size_t size);
 static ble_spp_relase_uplink_t enable_tx_cb;
 static ble_spp_new_downlink_t signal_newline_callback;
+/*Brings up the ble link, output written until then waits in the uplink and is released here*/
+static void __link_start() {
+    ble_spp_relase_uplink_t cb = setup_ble_spp();
+    MY_ASSERT_NOT(cb, NULL);
+    enable_tx_cb = cb;
+    ESP_LOGI(TAG, "Console_ll initialized");
+    enable_tx_cb();
+}
+
+#if (SPP_ASYNC_INIT == 1)
+static void __link_init_task(void *arg) {
+    __link_start();
+    vTaskDelete(NULL);
+}
+#endif
+
 void console_ll_init(ble_spp_new_downlink_t signal_newline_cb) {
+    ble_spp_boot_mark(SPP_BOOT_INIT);
     if (NULL == rx_queue) {
-        rx_queue = xQueueCreate(CONSOLE_PRINT_SIZE, sizeof(char));
+        rx_queue = SPP_QUEUE_CREATE(CONSOLE_PRINT_SIZE, sizeof(char));
+        MY_ASSERT_NOT(rx_queue, NULL);
     }
     if (NULL == tx_queue) {
-        tx_queue = xQueueCreate(CONSOLE_PRINT_SIZE, sizeof(char));
+        tx_queue = SPP_QUEUE_CREATE(CONSOLE_PRINT_SIZE, sizeof(char));
+        MY_ASSERT_NOT(tx_queue, NULL);
+    }
+    if (NULL == rx_record_ring) {
+        rx_record_ring = SPP_RINGBUF_CREATE(CONSOLE_RECORD_RING_SIZE, RINGBUF_TYPE_NOSPLIT);
+        MY_ASSERT_NOT(rx_record_ring, NULL);
+    }
+    if (NULL == tx_lock) {
+        tx_lock = SPP_MUTEX_CREATE();
+        MY_ASSERT_NOT(tx_lock, NULL);
+    }
+    if (NULL == tx_events) {
+        tx_events = SPP_EVENT_GROUP_CREATE();
+        MY_ASSERT_NOT(tx_events, NULL);
     }
     if (false == running) {
         enable_tx_cb = NULL;
-        ESP_LOGI(TAG, "Starting up ble link");
-        register_rw_callbacks(__link_rx, __link_tx);
-        register_get_uplink_len_callback(__get_tx_queue_len);
-        enable_tx_cb = setup_ble_spp();
-        MY_ASSERT_NOT(enable_tx_cb, NULL);
         MY_ASSERT_NOT(signal_newline_cb, NULL);
         signal_newline_callback = signal_newline_cb;
-        ESP_LOGI(TAG, "Console_ll initialized");
+        register_rw_callbacks(__link_rx, __link_tx);
+        register_get_uplink_len_callback(__get_tx_queue_len);
         running = true;
+#if (SPP_ASYNC_INIT == 1)
+        ESP_LOGI(TAG, "Starting up ble link in background");
+        MY_ASSERT_NOT(SPP_TASK_CREATE(__link_init_task, "spp_init", SPP_INIT_TASK_STACK, SPP_INIT_TASK_PRIO), NULL);
+#else
+        ESP_LOGI(TAG, "Starting up ble link");
+        __link_start();
+#endif
     }
+    ble_spp_boot_mark(SPP_BOOT_APP_RUNNING);
+}
+
+bool console_ll_link_up() {
+    return (NULL != enable_tx_cb);
+}
+
+void console_ll_set_mode(console_ll_mode_t mode) {
+    memset(&rx_record, 0, sizeof(rx_record));
+    console_mode = mode;
+    ble_spp_set_raw_uplink(CONSOLE_LL_MODE_RECORD == mode);
 }
 
 /* Get one Char from USART */
@@ -61,16 +123,147 @@ char console_ll_getc(bool block) {
     return (char)a_char;
 }
 
-void console_ll_putc(char c) {
-    MY_ASSERT_EQ(xQueueGenericSend(tx_queue, &c, 0, queueSEND_TO_BACK), pdPASS);
-    if (CONSOLE_LL_NEWLINE == c) {
+static TickType_t __ticks_left(TickType_t start, TickType_t ticks_to_wait) {
+    TickType_t spent = xTaskGetTickCount() - start;
+    if (portMAX_DELAY == ticks_to_wait) {
+        return portMAX_DELAY;
+    }
+    return (spent < ticks_to_wait) ? (ticks_to_wait - spent) : 0;
+}
+
+size_t console_ll_tx_space() {
+    return (size_t)uxQueueSpacesAvailable(tx_queue);
+}
+
+bool console_ll_wait_writable(size_t len, TickType_t ticks_to_wait) {
+    TickType_t start = xTaskGetTickCount();
+    for (;;) {
+        if (console_ll_tx_space() >= len) {
+            return true;
+        }
+        /*Clear, then check again, so a drain between the check and the clear is not lost*/
+        xEventGroupClearBits(tx_events, CONSOLE_LL_EVT_TX_DRAINED);
+        if (console_ll_tx_space() >= len) {
+            return true;
+        }
+        if (0 == xEventGroupWaitBits(tx_events, CONSOLE_LL_EVT_TX_DRAINED, pdFALSE, pdFALSE, __ticks_left(start, ticks_to_wait))) {
+            return (console_ll_tx_space() >= len);
+        }
+    }
+}
+
+/*Enqueues what the policy lets through with tx_lock held, returns bytes accepted and whether a newline went in*/
+static size_t __tx_enqueue(const uint8_t *buf, size_t len, console_ll_tx_policy_t policy, bool *newline) {
+    size_t space;
+    size_t n;
+    size_t skipped = 0;
+    size_t dropped = 0;
+    uint8_t oldest;
+    MY_ASSERT_EQ(xSemaphoreTake(tx_lock, portMAX_DELAY), pdPASS);
+    space = console_ll_tx_space();
+    if (CONSOLE_LL_TX_DROP_OLDEST == policy) {
+        /*Only the tail of a write larger than the uplink can survive,
+          the prefix counts as accepted and then dropped as the oldest data*/
+        if (len > CONSOLE_PRINT_SIZE) {
+            skipped = len - CONSOLE_PRINT_SIZE;
+            dropped = skipped;
+            buf += skipped;
+            len = CONSOLE_PRINT_SIZE;
+        }
+        for (; space < len; space++) {
+            xQueueReceive(tx_queue, &oldest, 0);
+            dropped++;
+        }
+        tx_stats.dropped_oldest += dropped;
+    }
+    n = (len < space) ? len : space;
+    for (size_t i = 0; i < n; i++) {
+        MY_ASSERT_EQ(xQueueGenericSend(tx_queue, &buf[i], 0, queueSEND_TO_BACK), pdPASS);
+        *newline |= (CONSOLE_LL_NEWLINE == buf[i]);
+    }
+#if (SPP_TRACE_ENABLE == 1)
+    tx_unreleased += skipped + n;
+#endif
+    xSemaphoreGive(tx_lock);
+    if (dropped > 0) {
+        SPP_TRACE(SPP_TRACE_TX_DROP, policy, dropped);
+    }
+    return skipped + n;
+}
+
+static void __tx_release() {
+#if (SPP_TRACE_ENABLE == 1)
+    size_t n;
+    MY_ASSERT_EQ(xSemaphoreTake(tx_lock, portMAX_DELAY), pdPASS);
+    n = tx_unreleased;
+    tx_unreleased = 0;
+    xSemaphoreGive(tx_lock);
+    SPP_TRACE(SPP_TRACE_TX_ENQUEUE, 0, n);
+#endif
 #if (CONSOLE_LL_DBG == 1)
-        ESP_LOGI(TAG, "Relasing TX");
+    ESP_LOGI(TAG, "Relasing TX");
 #endif
+    if (NULL != enable_tx_cb) {
         enable_tx_cb();
     }
 }
 
+static size_t __tx_write(const uint8_t *buf, size_t len, console_ll_tx_policy_t policy, TickType_t ticks_to_wait) {
+    TickType_t start = xTaskGetTickCount();
+    bool newline = false;
+    size_t done = __tx_enqueue(buf, len, policy, &newline);
+    if ((CONSOLE_LL_TX_BLOCK == policy) && (done < len)) {
+        tx_stats.waits++;
+        do {
+            /*A line longer than the uplink is released as is, otherwise nothing drains*/
+            __tx_release();
+            newline = false;
+            if (!console_ll_wait_writable(1, __ticks_left(start, ticks_to_wait))) {
+                break;
+            }
+            done += __tx_enqueue(&buf[done], len - done, policy, &newline);
+        } while (done < len);
+    }
+    if (done < len) {
+        if (CONSOLE_LL_TX_DROP_NEWEST == policy) {
+            tx_stats.dropped_newest += len - done;
+            SPP_TRACE(SPP_TRACE_TX_DROP, policy, len - done);
+        } else {
+            tx_stats.short_writes++;
+        }
+    }
+    /*In record mode the uplink is released per record, not per line.
+      A full uplink without a newline would never drain, release it as is*/
+    if ((CONSOLE_LL_MODE_TEXT == console_mode) && (newline || (done < len))) {
+        __tx_release();
+    }
+    return done;
+}
+
+/*Captured as offered, like putc, so a replay applies the policy to the same input*/
+size_t console_ll_write(const uint8_t *buf, size_t len, console_ll_tx_policy_t policy, TickType_t ticks_to_wait) {
+    SPP_CAPTURE(SPP_CAPTURE_PRODUCER, buf, len);
+    return __tx_write(buf, len, policy, ticks_to_wait);
+}
+
+void console_ll_putc(char c) {
+    SPP_CAPTURE_PUTC(c);
+    __tx_write((const uint8_t *)&c, 1, tx_policy, tx_policy_ticks);
+}
+
+void console_ll_set_tx_policy(console_ll_tx_policy_t policy, TickType_t ticks_to_wait) {
+    tx_policy = policy;
+    tx_policy_ticks = ticks_to_wait;
+}
+
+void console_ll_get_tx_stats(console_ll_tx_stats_t *stats) {
+    *stats = tx_stats;
+}
+
+uint32_t console_ll_get_rx_dropped() {
+    return rx_dropped;
+}
+
 void console_printf(const char *str, ...) {
     char buf[CONSOLE_PRINT_SIZE];
     int rc = 0;
@@ -79,42 +272,168 @@ void console_printf(const char *str, ...) {
     rc = vsnprintf(buf, CONSOLE_PRINT_SIZE, str, ptr);
     va_end(ptr);
     if (rc > 0) {
-        /*Copy to tx buffer*/
-        for (int i = 0; i < rc; i++) {
-            console_ll_putc(buf[i]);
+        /*rc is the untruncated length*/
+        console_ll_write((uint8_t *)buf, (rc < CONSOLE_PRINT_SIZE) ? rc : (CONSOLE_PRINT_SIZE - 1), tx_policy, tx_policy_ticks);
+    }
+}
+
+esp_err_t console_ll_send_record(const uint8_t *buf, size_t len, TickType_t ticks_to_wait) {
+    uint8_t hdr[CONSOLE_RECORD_HDR_LEN] = {len & 0xff, (len >> 8) & 0xff};
+    TickType_t start = xTaskGetTickCount();
+    if (len > CONSOLE_RECORD_MAX_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    /*Header and payload go in as one unit, so a record is never split by a full uplink*/
+    for (;;) {
+        if (pdPASS != xSemaphoreTake(tx_lock, __ticks_left(start, ticks_to_wait))) {
+            return ESP_ERR_TIMEOUT;
+        }
+        if (console_ll_tx_space() >= (len + CONSOLE_RECORD_HDR_LEN)) {
+            break;
+        }
+        xSemaphoreGive(tx_lock);
+        tx_stats.waits++;
+        if (!console_ll_wait_writable(len + CONSOLE_RECORD_HDR_LEN, __ticks_left(start, ticks_to_wait))) {
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+    for (int i = 0; i < CONSOLE_RECORD_HDR_LEN; i++) {
+        MY_ASSERT_EQ(xQueueGenericSend(tx_queue, &hdr[i], 0, queueSEND_TO_BACK), pdPASS);
+    }
+    for (int i = 0; i < len; i++) {
+        MY_ASSERT_EQ(xQueueGenericSend(tx_queue, &buf[i], 0, queueSEND_TO_BACK), pdPASS);
+    }
+    xSemaphoreGive(tx_lock);
+    SPP_CAPTURE(SPP_CAPTURE_PRODUCER, buf, len);
+    SPP_TRACE(SPP_TRACE_TX_ENQUEUE, 1, len);
+    if (NULL != enable_tx_cb) {
+        enable_tx_cb();
+    }
+    return ESP_OK;
+}
+
+size_t console_ll_recv_record(uint8_t *buf, size_t maxlen, TickType_t ticks_to_wait) {
+    size_t len = 0;
+    uint8_t *item = (uint8_t *)xRingbufferReceive(rx_record_ring, &len, ticks_to_wait);
+    if (NULL == item) {
+        return 0;
+    }
+    memcpy(buf, item, (len < maxlen) ? len : maxlen);
+    vRingbufferReturnItem(rx_record_ring, item);
+    return len;
+}
+
+esp_err_t console_ll_set_telemetry(const uint8_t *buf, size_t len) {
+    return ble_spp_broadcast_update(buf, len);
+}
+
+esp_err_t console_ll_send_delta(int schema_id, const void *rec, TickType_t ticks_to_wait) {
+    uint8_t frame[CONSOLE_RECORD_MAX_LEN];
+    size_t len;
+    esp_err_t ret;
+    if (CONSOLE_LL_MODE_RECORD != console_mode) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (spp_delta_schema_pending(schema_id)) {
+        len = spp_delta_schema_frame(schema_id, frame, sizeof(frame));
+        ret = (len > 0) ? console_ll_send_record(frame, len, ticks_to_wait) : ESP_ERR_INVALID_ARG;
+        if (ESP_OK != ret) {
+            /*Announcing every dictionary again is harmless and needs no per schema undo*/
+            spp_delta_resync();
+            return ret;
+        }
+    }
+    len = spp_delta_encode(schema_id, rec, frame, sizeof(frame));
+    if (0 == len) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ret = console_ll_send_record(frame, len, ticks_to_wait);
+    if (ESP_OK != ret) {
+        /*The decoder never sees this frame, the next one has to stand alone*/
+        spp_delta_force_key(schema_id);
+    }
+    return ret;
+}
+
+static void __link_rx_record(const char *src, size_t size) {
+    size_t n;
+    while (size > 0) {
+        if (rx_record.hdr_got < CONSOLE_RECORD_HDR_LEN) {
+            rx_record.hdr[rx_record.hdr_got++] = (uint8_t)*src++;
+            size--;
+            if (rx_record.hdr_got < CONSOLE_RECORD_HDR_LEN) {
+                continue;
+            }
+            rx_record.len = rx_record.hdr[0] | (rx_record.hdr[1] << 8);
+            rx_record.got = 0;
+            if (rx_record.len > CONSOLE_RECORD_MAX_LEN) {
+                ESP_LOGW(TAG, "Record length %u exceeds %d, dropping write", (unsigned)rx_record.len, CONSOLE_RECORD_MAX_LEN);
+                rx_record.hdr_got = 0;
+                return;
+            }
+        }
+        n = rx_record.len - rx_record.got;
+        n = (n < size) ? n : size;
+        memcpy(&rx_record.buf[rx_record.got], src, n);
+        rx_record.got += n;
+        src += n;
+        size -= n;
+        if (rx_record.got == rx_record.len) {
+            rx_record.hdr_got = 0;
+            if (rx_record.len == 0) {
+                continue;
+            }
+            if (pdTRUE != xRingbufferSend(rx_record_ring, rx_record.buf, rx_record.len, 0)) {
+                ESP_LOGW(TAG, "Downlink record ring full, dropping record");
+                rx_dropped += rx_record.len + CONSOLE_RECORD_HDR_LEN;
+                continue;
+            }
+            SPP_TRACE(SPP_TRACE_RX_DELIVER, 1, rx_record.len);
+            signal_newline_callback(rx_record.len);
         }
     }
 }
 
 static void __link_rx(const char *src, size_t size) {
 #if (CONSOLE_LL_DBG == 1)
-    ESP_LOGI(TAG, "rx: %s", src);
+    ESP_LOG_BUFFER_HEXDUMP(TAG, src, size, ESP_LOG_INFO);
 #endif
-    char tmp = CONSOLE_LL_NEWLINE;
+    SPP_CAPTURE(SPP_CAPTURE_DOWNLINK, src, size);
+    if (CONSOLE_LL_MODE_RECORD == console_mode) {
+        __link_rx_record(src, size);
+        return;
+    }
+    size_t sent = 0;
     if (rx_queue != NULL) {
-        for (int i = 0; i < size; i++) {
-            tmp = src[i];
-            MY_ASSERT_EQ(xQueueGenericSend(rx_queue, &tmp, 0, queueSEND_TO_BACK), pdPASS);
+        /*An application that falls behind loses the bytes that do not fit, the link callback must not wait*/
+        while ((sent < size) && (pdPASS == xQueueGenericSend(rx_queue, &src[sent], 0, queueSEND_TO_BACK))) {
+            sent++;
+        }
+        if (sent < size) {
+            ESP_LOGW(TAG, "Downlink queue full, dropping %d bytes", (int)(size - sent));
+            rx_dropped += size - sent;
+        }
+        if (sent > 0) {
+            SPP_TRACE(SPP_TRACE_RX_DELIVER, 0, sent);
+            signal_newline_callback(sent);
         }
-        //tmp = '\0';
-        //MY_ASSERT_EQ(xQueueGenericSend(rx_queue, &tmp, 0, queueSEND_TO_BACK), pdPASS);
-#if (CONSOLE_LL_DBG == 1)
-        ESP_LOGI(TAG, "New data %s", src);
-#endif
-        signal_newline_callback(size);
     }
 }
-static void __link_tx(uint8_t *buf, uint32_t length, TickType_t ticks_to_wait) {
+/*A producer dropping oldest bytes can empty the queue under a reader that counted it, so a short read is not an error*/
+static size_t __link_tx(uint8_t *buf, uint32_t length, TickType_t ticks_to_wait) {
     char tmp = CONSOLE_LL_NEWLINE;
+    size_t got = 0;
     if (tx_queue != NULL) {
-        for (int i = 0; i < length; i++) {
-            MY_ASSERT_EQ(xQueueGenericReceive(tx_queue, &tmp, ticks_to_wait, queueSEND_TO_BACK), pdPASS);
-            buf[i] = tmp;
+        while ((got < length) && (pdPASS == xQueueGenericReceive(tx_queue, &tmp, ticks_to_wait, queueSEND_TO_BACK))) {
+            buf[got++] = tmp;
         }
+        SPP_CAPTURE(SPP_CAPTURE_UPLINK, buf, got);
+        xEventGroupSetBits(tx_events, CONSOLE_LL_EVT_TX_DRAINED);
     }
 #if (CONSOLE_LL_DBG == 1)
-    ESP_LOGI(TAG, "tx: %s", buf);
+    ESP_LOG_BUFFER_HEXDUMP(TAG, buf, got, ESP_LOG_INFO);
 #endif
+    return got;
 }
 
 static size_t __get_tx_queue_len() {
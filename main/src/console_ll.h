@@ -1,10 +1,68 @@
 #pragma once
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "spp_config.h"
 #include "stdbool.h"
 #include <stddef.h>
 #include <stdint.h>
 #define GETC_NO_BLOCK (false)
 #define GETC_BLOCK (true)
+/*Record mode: every record on the link is framed as a 16bit little endian length followed by the payload.
+  Records may contain any byte value, including newline and NUL. The downlink callback is signaled once per complete record.
+  Records may span client writes. A length above CONSOLE_RECORD_MAX_LEN drops the rest of that write, the next write starts a new record.
+*/
+#define CONSOLE_RECORD_HDR_LEN (2)
+/*Downlink record reassembly, a record may arrive split over several writes. Declared here for the RAM budget*/
+typedef struct {
+    uint8_t hdr[CONSOLE_RECORD_HDR_LEN];
+    size_t hdr_got;
+    size_t len;
+    size_t got;
+    uint8_t buf[CONSOLE_RECORD_MAX_LEN];
+} console_ll_rx_record_t;
+typedef enum {
+    CONSOLE_LL_MODE_TEXT = 0,
+    CONSOLE_LL_MODE_RECORD,
+} console_ll_mode_t;
+/*What an uplink write does when the uplink is full, e.g. while disconnected or when producing faster than the link drains*/
+typedef enum {
+    CONSOLE_LL_TX_BLOCK = 0,   /*Wait up to ticks_to_wait for room, a partial line is released so the link can drain*/
+    CONSOLE_LL_TX_NONBLOCK,    /*Write what fits right now*/
+    CONSOLE_LL_TX_DROP_OLDEST, /*Write everything, discarding the oldest waiting bytes*/
+    CONSOLE_LL_TX_DROP_NEWEST, /*Write what fits, discarding the rest*/
+} console_ll_tx_policy_t;
+typedef struct {
+    uint32_t dropped_oldest; /*Bytes discarded by CONSOLE_LL_TX_DROP_OLDEST*/
+    uint32_t dropped_newest; /*Bytes discarded by CONSOLE_LL_TX_DROP_NEWEST*/
+    uint32_t short_writes;   /*BLOCK and NONBLOCK writes that returned less than asked*/
+    uint32_t waits;          /*Writes and records that had to wait for room*/
+} console_ll_tx_stats_t;
+/*Returns once the link is up, with SPP_ASYNC_INIT right after creating the queues while the link comes up in the background.
+  Output written before the link is up waits in the uplink and is subject to the putc policy.*/
 void console_ll_init();
+bool console_ll_link_up();
+void console_ll_set_mode(console_ll_mode_t mode);
 char console_ll_getc(bool block);
+/*putc and printf write with the policy set by console_ll_set_tx_policy(), CONSOLE_LL_TX_DROP_OLDEST by default*/
 void console_printf(const char *str, ...);
 void console_ll_putc(char c);
+void console_ll_set_tx_policy(console_ll_tx_policy_t policy, TickType_t ticks_to_wait);
+/*Text mode uplink write, returns bytes accepted. Lines are released to the link on newline*/
+size_t console_ll_write(const uint8_t *buf, size_t len, console_ll_tx_policy_t policy, TickType_t ticks_to_wait);
+size_t console_ll_tx_space();
+/*Blocks until len bytes fit in the uplink, signaled by the link every time it drains. Returns false on timeout*/
+bool console_ll_wait_writable(size_t len, TickType_t ticks_to_wait);
+void console_ll_get_tx_stats(console_ll_tx_stats_t *stats);
+/*Downlink bytes discarded because the application did not read them before its queue or record ring filled*/
+uint32_t console_ll_get_rx_dropped();
+/*Returns ESP_ERR_INVALID_SIZE for records above CONSOLE_RECORD_MAX_LEN, ESP_ERR_TIMEOUT when the uplink has no room before timeout*/
+esp_err_t console_ll_send_record(const uint8_t *buf, size_t len, TickType_t ticks_to_wait);
+/*Returns length of received record, 0 on timeout. Records longer than maxlen are truncated, the full length is still returned*/
+size_t console_ll_recv_record(uint8_t *buf, size_t maxlen, TickType_t ticks_to_wait);
+/*Replaces the telemetry record broadcast in advertising, latest call wins. ESP_ERR_INVALID_SIZE above SPP_BROADCAST_MAX_LEN,
+  ESP_ERR_NOT_SUPPORTED without SPP_BROADCAST_ENABLE*/
+esp_err_t console_ll_set_telemetry(const uint8_t *buf, size_t len);
+/*Sends rec, laid out as the schema registered with spp_delta_register() describes, as a keyframe or delta record,
+  preceded by the schema dictionary when the client has not seen it yet. Record mode only, ESP_ERR_INVALID_STATE otherwise.
+  Other errors as console_ll_send_record, a record that could not be sent makes the next one a keyframe.*/
+esp_err_t console_ll_send_delta(int schema_id, const void *rec, TickType_t ticks_to_wait);
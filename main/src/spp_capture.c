@@ -0,0 +1,117 @@
+/*Traffic capture for the ble link.
+  Chunks are appended to a flat buffer and printed on the console as hex lines when dumped:
+  SPPCAP BEGIN <bytes>
+  SPPCAP <up to 32 bytes as hex>
+  SPPCAP END <dropped chunks>
+*/
+
+#include "spp_capture.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
+
+#define SPP_CAPTURE_HDR_LEN (7)
+#define SPP_CAPTURE_LINE_LEN (32)
+
+#if (SPP_CAPTURE_ENABLE == 1)
+static uint8_t cap_buf[SPP_CAPTURE_SIZE];
+static size_t cap_len = 0;
+static uint32_t cap_dropped = 0;
+static bool cap_paused = false;
+static uint8_t putc_buf[SPP_CAPTURE_PUTC_COALESCE];
+static size_t putc_len = 0;
+static uint32_t putc_ts = 0;
+static portMUX_TYPE cap_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/*Called with cap_mux held*/
+static void __capture_store(uint32_t ts, uint8_t dir, const uint8_t *buf, size_t len) {
+    uint8_t *dst = &cap_buf[cap_len];
+    if (cap_paused || ((cap_len + SPP_CAPTURE_HDR_LEN + len) > SPP_CAPTURE_SIZE)) {
+        cap_dropped++;
+        return;
+    }
+    dst[0] = ts & 0xff;
+    dst[1] = (ts >> 8) & 0xff;
+    dst[2] = (ts >> 16) & 0xff;
+    dst[3] = (ts >> 24) & 0xff;
+    dst[4] = dir;
+    dst[5] = len & 0xff;
+    dst[6] = (len >> 8) & 0xff;
+    memcpy(dst + SPP_CAPTURE_HDR_LEN, buf, len);
+    cap_len += SPP_CAPTURE_HDR_LEN + len;
+}
+
+/*Called with cap_mux held*/
+static void __capture_flush_putc() {
+    if (putc_len > 0) {
+        __capture_store(putc_ts, SPP_CAPTURE_PRODUCER, putc_buf, putc_len);
+        putc_len = 0;
+    }
+}
+
+void spp_capture_chunk(uint8_t dir, const uint8_t *buf, size_t len) {
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    portENTER_CRITICAL_SAFE(&cap_mux);
+    /*Keep producer bytes ordered against the chunk*/
+    __capture_flush_putc();
+    __capture_store(now, dir, buf, len);
+    portEXIT_CRITICAL_SAFE(&cap_mux);
+}
+
+void spp_capture_putc(char c) {
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    portENTER_CRITICAL_SAFE(&cap_mux);
+    if (0 == putc_len) {
+        putc_ts = now;
+    }
+    putc_buf[putc_len++] = (uint8_t)c;
+    if ((putc_len == SPP_CAPTURE_PUTC_COALESCE) || ('\n' == c)) {
+        __capture_flush_putc();
+    }
+    portEXIT_CRITICAL_SAFE(&cap_mux);
+}
+
+void spp_capture_flush() {
+    portENTER_CRITICAL_SAFE(&cap_mux);
+    __capture_flush_putc();
+    portEXIT_CRITICAL_SAFE(&cap_mux);
+}
+
+void spp_capture_dump() {
+    size_t len;
+    portENTER_CRITICAL(&cap_mux);
+    __capture_flush_putc();
+    cap_paused = true;
+    len = cap_len;
+    portEXIT_CRITICAL(&cap_mux);
+    printf("SPPCAP BEGIN %u\n", (unsigned)len);
+    for (size_t i = 0; i < len; i += SPP_CAPTURE_LINE_LEN) {
+        printf("SPPCAP ");
+        for (size_t j = i; (j < len) && (j < (i + SPP_CAPTURE_LINE_LEN)); j++) {
+            printf("%02x", cap_buf[j]);
+        }
+        printf("\n");
+    }
+    printf("SPPCAP END %u\n", (unsigned)cap_dropped);
+    portENTER_CRITICAL(&cap_mux);
+    cap_len = 0;
+    cap_dropped = 0;
+    cap_paused = false;
+    portEXIT_CRITICAL(&cap_mux);
+}
+#else
+static const char *TAG = "spp_capture";
+
+void spp_capture_chunk(uint8_t dir, const uint8_t *buf, size_t len) {
+}
+
+void spp_capture_putc(char c) {
+}
+
+void spp_capture_flush() {
+}
+
+void spp_capture_dump() {
+    ESP_LOGW(TAG, "Capture not compiled in, set SPP_CAPTURE_ENABLE in bsp.h");
+}
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+#include "bsp.h"
+#include <stdint.h>
+/*Traffic capture at the console_ll boundary, compiled in with SPP_CAPTURE_ENABLE.
+  Each chunk is stored as a 7 byte header, 32bit microsecond timestamp, direction and 16bit length, followed by the payload.
+  Capturing stops when SPP_CAPTURE_SIZE is full, later chunks are counted as dropped until the next dump.
+  Convert a dump with tools/spp_capture_extract.py and replay it with tools/replay.
+*/
+typedef enum {
+    SPP_CAPTURE_DOWNLINK = 0, /*Client write handed to console_ll*/
+    SPP_CAPTURE_PRODUCER = 1, /*Bytes written by the application with putc/printf/send_record*/
+    SPP_CAPTURE_UPLINK = 2,   /*Bytes pulled from the uplink by link_task*/
+} spp_capture_dir_t;
+
+#if (SPP_CAPTURE_ENABLE == 1)
+#define SPP_CAPTURE(dir, buf, len) spp_capture_chunk((dir), (const uint8_t *)(buf), (len))
+#define SPP_CAPTURE_PUTC(c) spp_capture_putc(c)
+#define SPP_CAPTURE_FLUSH() spp_capture_flush()
+#else
+#define SPP_CAPTURE(dir, buf, len) \
+    do {                           \
+    } while (0)
+#define SPP_CAPTURE_PUTC(c) \
+    do {                    \
+    } while (0)
+#define SPP_CAPTURE_FLUSH() \
+    do {                    \
+    } while (0)
+#endif
+
+void spp_capture_chunk(uint8_t dir, const uint8_t *buf, size_t len);
+/*Producer bytes are coalesced and stored as one chunk on flush, newline or when SPP_CAPTURE_PUTC_COALESCE is reached*/
+void spp_capture_putc(char c);
+void spp_capture_flush();
+void spp_capture_dump();
@@ -0,0 +1,66 @@
+#pragma once
+/*Buffer, queue and stack sizes of the ble link in one place.
+  With SPP_STATIC_ALLOCATION set every queue, semaphore, ring buffer and task is created with the *CreateStatic variants
+  from the buffers sized here, nothing the link creates is taken from the heap after boot. Needs CONFIG_FREERTOS_SUPPORT_STATIC_ALLOCATION.
+  Heap users outside that: the esp_timers of the advertising schedule and broadcast and the NVS handle of the sessions, each
+  allocated once during bring-up, and whatever bluedroid, the controller and NVS writes allocate internally.
+  The resulting static RAM is checked against SPP_STATIC_RAM_BUDGET at compile time and printed by ble_spp_mem_report().
+*/
+#define SPP_STATIC_ALLOCATION 0
+#define SPP_STATIC_RAM_BUDGET (24 * 1024)
+
+/*console_ll*/
+#define CONSOLE_PRINT_SIZE (256)                         /*Uplink and downlink byte queues, also printf buffer*/
+#define CONSOLE_RECORD_MAX_LEN (240)                     /*Largest payload in record mode*/
+#define CONSOLE_RECORD_RING_SIZE (4 * CONSOLE_PRINT_SIZE) /*Downlink record ring, 8 byte aligned*/
+
+/*ble_spp_server*/
+#define UPLINK_BUFSIZE (512)                /*link_task line buffer, on its stack*/
+#define SPP_NTF_BUF_LEN (517 - 3)           /*One notification at the largest MTU*/
+#define SPP_PREP_BUF_LEN (2 * 1024)         /*Prepared (long) writes, static mode only*/
+#define SPP_CMD_QUEUE_LEN (10)
+#define SPP_HEARTBEAT_QUEUE_LEN (10)
+#define SPP_LINK_TASK_STACK (4096)
+#define SPP_LINK_TASK_PRIO (8)
+#define SPP_CMD_TASK_STACK (2048)
+#define SPP_CMD_TASK_PRIO (10)
+#define SPP_HEARTBEAT_TASK_STACK (2048)
+#define SPP_HEARTBEAT_TASK_PRIO (10)
+/*Bring the link up in a task of its own, console_ll_init returns right after creating the queues*/
+#define SPP_ASYNC_INIT 0
+#define SPP_INIT_TASK_STACK (3072)
+#define SPP_INIT_TASK_PRIO (5)
+/*Reliable uplink: sequence numbered notifications acknowledged on the command characteristic*/
+#define SPP_RELIABLE_UPLINK 0
+#define SPP_REL_WINDOW (8)        /*Notifications in flight, power of two*/
+#define SPP_REL_SLOT_LEN (244)    /*Payload per notification, one LE data length PDU*/
+#define SPP_REL_TIMEOUT_MS (400)  /*Go back to the oldest unacknowledged notification after this*/
+/*Pull mode: the client reads the data characteristic, long reads included, instead of waiting for notifications*/
+#define SPP_PULL_UPLINK 0
+#define SPP_PULL_LEN (512) /*Largest value, the ATT attribute limit*/
+/*Delta encoded telemetry records, see spp_delta.h*/
+#define SPP_DELTA_MAX_SCHEMAS (4)
+#define SPP_DELTA_MAX_FIELDS (32)
+/*Advertising schedule from boot and after every disconnect, {adv_int_min, adv_int_max (0.625ms units), duration ms}.
+  Stages back off from fast to slow, the last one runs until a central connects.*/
+#define SPP_ADV_STAGES {{0x20, 0x30, 3000}, {0xa0, 0xf0, 30000}, {0x640, 0x780, 0}}
+#define SPP_ADV_DIRECTED_MS (1280) /*High duty directed advertising to a bonded peer before the stages, 0 disables*/
+/*Session state of bonded peers restored from NVS on reconnect, see spp_session.h*/
+#define SPP_SESSION_PERSIST 1
+#define SPP_SESSION_NVS_NAMESPACE "spp_sess"
+/*Broadcast telemetry: a small record carried in advertising manufacturer data for observers that never connect*/
+#define SPP_BROADCAST_ENABLE 0
+#define SPP_BROADCAST_PERIOD_MS (200)            /*Fastest payload refresh with no central connected, also the timer period*/
+#define SPP_BROADCAST_PERIOD_CONNECTED_MS (1000) /*Fastest payload refresh while a central is connected*/
+#define SPP_BROADCAST_ADV_INT (0x100)            /*Scannable advertising interval while connected, 0.625ms units*/
+#define SPP_BROADCAST_COMPANY_ID (0xFFFF)        /*Bluetooth SIG company id in the manufacturer data, 0xFFFF is for testing*/
+/*ble_spp_mem_report() warns when a task never used more than this share of its stack*/
+#define SPP_STACK_OVERSIZE_PCT (50)
+#define SPP_STACK_MIN_FREE (256)
+
+/*spp_trace*/
+#define SPP_TRACE_DEPTH (512) /*Must be a power of two*/
+
+/*spp_capture*/
+#define SPP_CAPTURE_SIZE (8 * 1024)
+#define SPP_CAPTURE_PUTC_COALESCE (64)
@@ -0,0 +1,218 @@
+/*Delta and dictionary encoder for telemetry records, frame layout in spp_delta.h*/
+
+#include "spp_delta.h"
+#include "esp_timer.h"
+#include <string.h>
+
+#define SPP_DELTA_FRAME_HDR_LEN (3) /*type, id, seq*/
+#define SPP_DELTA_VARINT_MAX (5)
+#define SPP_DELTA_BITMAP_LEN ((SPP_DELTA_MAX_FIELDS + 7) / 8)
+static const char *TAG = "spp_delta";
+static const uint8_t field_width[] = {
+    [SPP_DELTA_U8] = 1, [SPP_DELTA_I8] = 1, [SPP_DELTA_U16] = 2, [SPP_DELTA_I16] = 2,
+    [SPP_DELTA_U32] = 4, [SPP_DELTA_I32] = 4, [SPP_DELTA_F32] = 4,
+};
+
+static spp_delta_enc_t enc[SPP_DELTA_MAX_SCHEMAS];
+static int enc_num = 0;
+/*Bumped by every resync. A frame taken while it moves does not count for the new generation, so a resync is never lost*/
+static volatile uint32_t resync_gen = 0;
+static portMUX_TYPE resync_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static bool __valid(int id) {
+    return (id >= 0) && (id < enc_num);
+}
+
+/*Field as its raw bits, sign extended so a difference between two signed values stays small*/
+static uint32_t __field_get(const spp_delta_field_t *f, const uint8_t *rec) {
+    uint8_t u8;
+    uint16_t u16;
+    uint32_t u32;
+    switch (f->type) {
+    case SPP_DELTA_U8:
+    case SPP_DELTA_I8:
+        memcpy(&u8, rec + f->offset, 1);
+        return (SPP_DELTA_I8 == f->type) ? (uint32_t)(int32_t)(int8_t)u8 : u8;
+    case SPP_DELTA_U16:
+    case SPP_DELTA_I16:
+        memcpy(&u16, rec + f->offset, 2);
+        return (SPP_DELTA_I16 == f->type) ? (uint32_t)(int32_t)(int16_t)u16 : u16;
+    default:
+        memcpy(&u32, rec + f->offset, 4);
+        return u32;
+    }
+}
+
+static size_t __put_le(uint8_t *out, uint32_t v, uint8_t width) {
+    for (uint8_t i = 0; i < width; i++) {
+        out[i] = (v >> (8 * i)) & 0xff;
+    }
+    return width;
+}
+
+static size_t __put_varint(uint8_t *out, uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    out[n++] = v;
+    return n;
+}
+
+static size_t __put_str(uint8_t *out, const char *s) {
+    size_t len = strlen(s);
+    out[0] = len;
+    memcpy(out + 1, s, len);
+    return len + 1;
+}
+
+static size_t __schema_len(const spp_delta_schema_t *schema) {
+    size_t len = 5 + 1 + strlen(schema->name);
+    for (uint8_t i = 0; i < schema->num_fields; i++) {
+        len += 2 + strlen(schema->fields[i].name);
+    }
+    return len;
+}
+
+int spp_delta_register(const spp_delta_schema_t *schema) {
+    uint16_t width = 0;
+    if ((enc_num >= SPP_DELTA_MAX_SCHEMAS) || (0 == schema->num_fields) || (schema->num_fields > SPP_DELTA_MAX_FIELDS) ||
+        (__schema_len(schema) > CONSOLE_RECORD_MAX_LEN)) {
+        ESP_LOGE(TAG, "Schema %s does not fit", schema->name);
+        return -1;
+    }
+    for (uint8_t i = 0; i < schema->num_fields; i++) {
+        if (schema->fields[i].type > SPP_DELTA_F32) {
+            ESP_LOGE(TAG, "Schema %s field %u is invalid", schema->name, i);
+            return -1;
+        }
+        width += field_width[schema->fields[i].type];
+    }
+    /*Worst case delta: every field changed, integers as 5 byte varints*/
+    if ((SPP_DELTA_FRAME_HDR_LEN + SPP_DELTA_BITMAP_LEN + schema->num_fields * SPP_DELTA_VARINT_MAX) > CONSOLE_RECORD_MAX_LEN) {
+        ESP_LOGE(TAG, "Schema %s does not fit", schema->name);
+        return -1;
+    }
+    memset(&enc[enc_num], 0, sizeof(enc[enc_num]));
+    enc[enc_num].schema = schema;
+    enc[enc_num].schema_gen = resync_gen - 1;
+    enc[enc_num].key_pending = true;
+    ESP_LOGI(TAG, "Schema %s id %d, %u fields, %u bytes per record", schema->name, enc_num, schema->num_fields, width);
+    return enc_num++;
+}
+
+bool spp_delta_schema_pending(int id) {
+    return __valid(id) && (enc[id].schema_gen != resync_gen);
+}
+
+size_t spp_delta_schema_frame(int id, uint8_t *out, size_t maxlen) {
+    const spp_delta_schema_t *schema;
+    uint32_t gen = resync_gen;
+    size_t n = 0;
+    if (!__valid(id) || (maxlen < __schema_len(enc[id].schema))) {
+        return 0;
+    }
+    schema = enc[id].schema;
+    out[n++] = SPP_DELTA_FRAME_SCHEMA;
+    out[n++] = id;
+    out[n++] = schema->num_fields;
+    n += __put_le(&out[n], schema->keyframe_interval, 2);
+    n += __put_str(&out[n], schema->name);
+    for (uint8_t i = 0; i < schema->num_fields; i++) {
+        out[n++] = schema->fields[i].type;
+        n += __put_str(&out[n], schema->fields[i].name);
+    }
+    enc[id].schema_gen = gen;
+    enc[id].stats.encoded_bytes += n;
+    return n;
+}
+
+size_t spp_delta_encode(int id, const void *rec, uint8_t *out, size_t maxlen) {
+    const spp_delta_schema_t *schema;
+    int64_t start = esp_timer_get_time();
+    uint8_t buf[CONSOLE_RECORD_MAX_LEN];
+    uint8_t *bitmap;
+    uint32_t v;
+    uint32_t raw = 0;
+    uint32_t gen = resync_gen;
+    size_t n = SPP_DELTA_FRAME_HDR_LEN;
+    bool key;
+    if (!__valid(id)) {
+        return 0;
+    }
+    schema = enc[id].schema;
+    key = enc[id].key_pending || (enc[id].key_gen != gen) || ((schema->keyframe_interval > 0) && (enc[id].since_key >= schema->keyframe_interval));
+    buf[0] = key ? SPP_DELTA_FRAME_KEY : SPP_DELTA_FRAME_DELTA;
+    buf[1] = id;
+    buf[2] = enc[id].seq;
+    bitmap = &buf[n];
+    if (!key) {
+        memset(bitmap, 0, (schema->num_fields + 7) / 8);
+        n += (schema->num_fields + 7) / 8;
+    }
+    for (uint8_t i = 0; i < schema->num_fields; i++) {
+        const spp_delta_field_t *f = &schema->fields[i];
+        v = __field_get(f, rec);
+        if (key) {
+            n += __put_le(&buf[n], v, field_width[f->type]);
+        } else if (v != enc[id].prev[i]) {
+            bitmap[i / 8] |= 1 << (i % 8);
+            if (SPP_DELTA_F32 == f->type) {
+                n += __put_le(&buf[n], v, 4);
+            } else {
+                /*Zigzag, small differences of either sign take one byte*/
+                int32_t d = (int32_t)(v - enc[id].prev[i]);
+                n += __put_varint(&buf[n], ((uint32_t)d << 1) ^ (uint32_t)(d >> 31));
+            }
+        }
+        enc[id].prev[i] = v;
+        raw += field_width[f->type];
+    }
+    if (n > maxlen) {
+        /*prev already moved on, the decoder needs a keyframe to follow*/
+        enc[id].key_pending = true;
+        return 0;
+    }
+    memcpy(out, buf, n);
+    enc[id].seq++;
+    enc[id].since_key = key ? 1 : (enc[id].since_key + 1);
+    enc[id].key_pending = false;
+    enc[id].key_gen = gen;
+    enc[id].stats.records++;
+    enc[id].stats.keyframes += key ? 1 : 0;
+    enc[id].stats.raw_bytes += raw;
+    enc[id].stats.encoded_bytes += n;
+    enc[id].stats.encode_us += (uint32_t)(esp_timer_get_time() - start);
+    return n;
+}
+
+void spp_delta_force_key(int id) {
+    if (__valid(id)) {
+        enc[id].key_pending = true;
+    }
+}
+
+/*Called from the bluedroid task on connect and from producers after a failed schema frame*/
+void spp_delta_resync() {
+    portENTER_CRITICAL(&resync_mux);
+    resync_gen++;
+    portEXIT_CRITICAL(&resync_mux);
+}
+
+void spp_delta_get_stats(int id, spp_delta_stats_t *stats) {
+    if (__valid(id)) {
+        *stats = enc[id].stats;
+    } else {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
+
+void spp_delta_report() {
+    for (int i = 0; i < enc_num; i++) {
+        spp_delta_stats_t *s = &enc[i].stats;
+        ESP_LOGI(TAG, "%-12s %u records, %u keyframes, %u raw bytes -> %u encoded, %u.%02u x, %u us per record", enc[i].schema->name,
+                 s->records, s->keyframes, s->raw_bytes, s->encoded_bytes, s->encoded_bytes ? (s->raw_bytes / s->encoded_bytes) : 0,
+                 s->encoded_bytes ? ((s->raw_bytes * 100 / s->encoded_bytes) % 100) : 0, s->records ? (s->encode_us / s->records) : 0);
+    }
+}
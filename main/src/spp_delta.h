@@ -0,0 +1,78 @@
+#pragma once
+#include "bsp.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+/*Delta and dictionary encoder for fixed layout telemetry records, sent as console_ll records with console_ll_send_delta().
+  A producer registers a schema, its record struct with a name and type per field. The field names go on the link once
+  in a schema frame, the dictionary, after that every record is a keyframe with all fields or a delta with only the
+  changed ones: integers as a zigzag varint of the difference to the previous record, floats raw.
+  Frames, told apart from other records by the first byte:
+  SCHEMA 0xD0 id n_fields interval_lo interval_hi name_len name {type name_len name} per field
+  KEY    0xD1 id seq every field little endian at its width
+  DELTA  0xD2 id seq bitmap[(n_fields + 7) / 8] changed fields in order, bit i of byte i / 8 for field i
+  seq counts the record frames of a schema, after a gap the decoder waits for the next keyframe.
+  Decode with tools/spp_delta_decode.py
+*/
+#define SPP_DELTA_FRAME_SCHEMA (0xD0)
+#define SPP_DELTA_FRAME_KEY (0xD1)
+#define SPP_DELTA_FRAME_DELTA (0xD2)
+
+typedef enum {
+    SPP_DELTA_U8 = 0,
+    SPP_DELTA_I8,
+    SPP_DELTA_U16,
+    SPP_DELTA_I16,
+    SPP_DELTA_U32,
+    SPP_DELTA_I32,
+    SPP_DELTA_F32,
+} spp_delta_type_t;
+
+typedef struct {
+    const char *name;
+    uint8_t type;    /*spp_delta_type_t*/
+    uint16_t offset; /*In the producer's record struct*/
+} spp_delta_field_t;
+#define SPP_DELTA_FIELD(rec_type, member, type) {#member, (type), offsetof(rec_type, member)}
+
+typedef struct {
+    const char *name;
+    const spp_delta_field_t *fields;
+    uint8_t num_fields;         /*Up to SPP_DELTA_MAX_FIELDS*/
+    uint16_t keyframe_interval; /*Records per keyframe, 0 sends keyframes only after a resync*/
+} spp_delta_schema_t;
+
+typedef struct {
+    uint32_t records;
+    uint32_t keyframes;
+    uint32_t raw_bytes;     /*Field bytes of the records encoded*/
+    uint32_t encoded_bytes; /*Frame bytes, schema frames included*/
+    uint32_t encode_us;     /*Time spent in spp_delta_encode()*/
+} spp_delta_stats_t;
+
+/*Encoder state per schema, declared here for the RAM budget. A schema is only encoded from one producer task,
+  spp_delta_resync() comes from any task and only bumps a generation the encoder compares against*/
+typedef struct {
+    const spp_delta_schema_t *schema;
+    uint32_t schema_gen; /*Resync generation the last schema frame was taken in*/
+    uint32_t key_gen;    /*Resync generation the last keyframe was encoded in*/
+    bool key_pending;    /*Keyframe forced by the producer task*/
+    uint8_t seq;
+    uint16_t since_key;
+    uint32_t prev[SPP_DELTA_MAX_FIELDS];
+    spp_delta_stats_t stats;
+} spp_delta_enc_t;
+
+/*Returns the schema id, -1 when SPP_DELTA_MAX_SCHEMAS are taken or the schema does not fit. The schema must stay valid*/
+int spp_delta_register(const spp_delta_schema_t *schema);
+/*True until the dictionary of schema id has been taken with spp_delta_schema_frame()*/
+bool spp_delta_schema_pending(int id);
+/*Both return the frame length written to out, 0 for an unknown id or when maxlen is too small*/
+size_t spp_delta_schema_frame(int id, uint8_t *out, size_t maxlen);
+size_t spp_delta_encode(int id, const void *rec, uint8_t *out, size_t maxlen);
+/*Next record frame of schema id is a keyframe, e.g. after the previous frame never made it to the uplink*/
+void spp_delta_force_key(int id);
+/*Every schema announces its dictionary again and continues with a keyframe, for a client that just connected*/
+void spp_delta_resync();
+void spp_delta_get_stats(int id, spp_delta_stats_t *stats);
+void spp_delta_report();
@@ -0,0 +1,84 @@
+/*Per peer session records in NVS, keyed by the peer address as 12 hex digits.
+  The namespace is opened once at init and the handle kept, nvs_open takes a handle entry from the heap every time*/
+
+#include "spp_session.h"
+#include "nvs.h"
+#include <stdio.h>
+#include <string.h>
+
+#define SPP_SESSION_KEY_LEN (13)
+#if (SPP_SESSION_PERSIST == 1)
+static const char *TAG = "spp_session";
+static nvs_handle_t sess_handle;
+static bool sess_open = false;
+
+static void __session_key(const uint8_t *bda, char *key) {
+    snprintf(key, SPP_SESSION_KEY_LEN, "%02x%02x%02x%02x%02x%02x", bda[0], bda[1], bda[2], bda[3], bda[4], bda[5]);
+}
+
+void spp_session_init() {
+    esp_err_t ret = nvs_open(SPP_SESSION_NVS_NAMESPACE, NVS_READWRITE, &sess_handle);
+    if (ESP_OK != ret) {
+        ESP_LOGE(TAG, "nvs_open failed: %s, sessions are not kept", esp_err_to_name(ret));
+        return;
+    }
+    sess_open = true;
+}
+
+bool spp_session_load(const uint8_t *bda, spp_session_t *sess) {
+    char key[SPP_SESSION_KEY_LEN];
+    size_t len = sizeof(*sess);
+    esp_err_t ret;
+    if (!sess_open) {
+        return false;
+    }
+    __session_key(bda, key);
+    ret = nvs_get_blob(sess_handle, key, sess, &len);
+    if ((ESP_OK != ret) || (len != sizeof(*sess)) || (SPP_SESSION_VERSION != sess->version)) {
+        return false;
+    }
+    return true;
+}
+
+void spp_session_store(const uint8_t *bda, const spp_session_t *sess) {
+    char key[SPP_SESSION_KEY_LEN];
+    spp_session_t old;
+    esp_err_t ret;
+    /*Unchanged sessions are not rewritten, saves flash wear on every reconnect*/
+    if (!sess_open || (spp_session_load(bda, &old) && (0 == memcmp(&old, sess, sizeof(old))))) {
+        return;
+    }
+    __session_key(bda, key);
+    ret = nvs_set_blob(sess_handle, key, sess, sizeof(*sess));
+    if (ESP_OK == ret) {
+        ret = nvs_commit(sess_handle);
+    }
+    if (ESP_OK != ret) {
+        ESP_LOGE(TAG, "Storing session %s failed: %s", key, esp_err_to_name(ret));
+    }
+}
+
+void spp_session_forget(const uint8_t *bda) {
+    char key[SPP_SESSION_KEY_LEN];
+    if (!sess_open) {
+        return;
+    }
+    __session_key(bda, key);
+    if (ESP_OK == nvs_erase_key(sess_handle, key)) {
+        nvs_commit(sess_handle);
+    }
+}
+#else
+void spp_session_init() {
+}
+
+bool spp_session_load(const uint8_t *bda, spp_session_t *sess) {
+    return false;
+}
+
+void spp_session_store(const uint8_t *bda, const spp_session_t *sess) {
+}
+
+void spp_session_forget(const uint8_t *bda) {
+}
+#endif
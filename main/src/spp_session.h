@@ -0,0 +1,27 @@
+#pragma once
+#include "bsp.h"
+#include <stdbool.h>
+#include <stdint.h>
+/*Per peer session state kept in NVS, so a bonded client that reconnects gets its notifications without
+  rewriting the CCCD. One blob per peer identity address in namespace SPP_SESSION_NVS_NAMESPACE, records are only
+  written for bonded peers so their number stays within the bond table.
+*/
+#define SPP_SESSION_VERSION (1)
+#define SPP_SESSION_DATA_NTF (1 << 0)  /*Data characteristic CCCD*/
+#define SPP_SESSION_HEART_NTF (1 << 1) /*Heartbeat characteristic CCCD*/
+#define SPP_SESSION_RELIABLE (1 << 2)  /*Reliable uplink was on*/
+#define SPP_SESSION_PULL (1 << 3)      /*Pull mode was on*/
+
+typedef struct {
+    uint8_t version;
+    uint8_t flags;
+    uint16_t mtu;       /*MTU of the last connection*/
+    uint16_t rel_acked; /*Last uplink sequence acknowledged by the client, only reported: reliable uplink restarts at 0*/
+} spp_session_t;
+
+/*Opens the NVS namespace once, after nvs_flash_init. Without it load finds nothing and store does nothing*/
+void spp_session_init();
+/*Returns true and fills sess if a record for bda exists*/
+bool spp_session_load(const uint8_t *bda, spp_session_t *sess);
+void spp_session_store(const uint8_t *bda, const spp_session_t *sess);
+void spp_session_forget(const uint8_t *bda);
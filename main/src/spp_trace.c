@@ -0,0 +1,78 @@
+/*Binary event trace ring for the ble link.
+  Records are stored raw and only formatted when dumped, the dump is printed on the console as hex lines:
+  SPPTRACE BEGIN <count> <depth>
+  SPPTRACE <16 hex chars> (little endian record)
+  SPPTRACE END <dropped>
+*/
+
+#include "spp_trace.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
+
+#if (SPP_TRACE_ENABLE == 1)
+typedef struct {
+    uint32_t ts_us;
+    uint8_t evt;
+    uint8_t aux;
+    uint16_t arg;
+} spp_trace_rec_t;
+
+static spp_trace_rec_t trace_ring[SPP_TRACE_DEPTH];
+static uint32_t trace_head = 0;
+static uint32_t trace_dropped = 0;
+static bool trace_paused = false;
+static portMUX_TYPE trace_mux = portMUX_INITIALIZER_UNLOCKED;
+
+void spp_trace_record(uint8_t evt, uint8_t aux, uint16_t arg) {
+    portENTER_CRITICAL_SAFE(&trace_mux);
+    if (trace_paused) {
+        trace_dropped++;
+    } else {
+        /*Stamped under the lock, so timestamps in the ring never go backwards*/
+        spp_trace_rec_t *rec = &trace_ring[trace_head & (SPP_TRACE_DEPTH - 1)];
+        rec->ts_us = (uint32_t)esp_timer_get_time();
+        rec->evt = evt;
+        rec->aux = aux;
+        rec->arg = arg;
+        trace_head++;
+    }
+    portEXIT_CRITICAL_SAFE(&trace_mux);
+}
+
+void spp_trace_dump() {
+    uint32_t head, count, first;
+    uint8_t raw[sizeof(spp_trace_rec_t)];
+    /*Recording is paused while printing, events in this window are counted as dropped*/
+    portENTER_CRITICAL(&trace_mux);
+    trace_paused = true;
+    head = trace_head;
+    portEXIT_CRITICAL(&trace_mux);
+    count = (head < SPP_TRACE_DEPTH) ? head : SPP_TRACE_DEPTH;
+    first = head - count;
+    printf("SPPTRACE BEGIN %u %d\n", (unsigned)count, SPP_TRACE_DEPTH);
+    for (uint32_t i = first; i != head; i++) {
+        memcpy(raw, &trace_ring[i & (SPP_TRACE_DEPTH - 1)], sizeof(raw));
+        printf("SPPTRACE ");
+        for (int j = 0; j < sizeof(raw); j++) {
+            printf("%02x", raw[j]);
+        }
+        printf("\n");
+    }
+    printf("SPPTRACE END %u\n", (unsigned)trace_dropped);
+    portENTER_CRITICAL(&trace_mux);
+    trace_head = 0;
+    trace_dropped = 0;
+    trace_paused = false;
+    portEXIT_CRITICAL(&trace_mux);
+}
+#else
+static const char *TAG = "spp_trace";
+
+void spp_trace_record(uint8_t evt, uint8_t aux, uint16_t arg) {
+}
+
+void spp_trace_dump() {
+    ESP_LOGW(TAG, "Tracing not compiled in, set SPP_TRACE_ENABLE in bsp.h");
+}
+#endif
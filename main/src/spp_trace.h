@@ -0,0 +1,38 @@
+#pragma once
+#include "bsp.h"
+#include <stdint.h>
+/*Compile time enabled binary trace ring.
+  Every record is 8 bytes: 32bit microsecond timestamp, event id, aux byte and 16bit argument.
+  Recording is a few instructions under a spinlock, so it can stay on the hot paths without changing timing the way ESP_LOGx does.
+  Decode the dump with tools/spp_trace_decode.py
+*/
+typedef enum {
+    SPP_TRACE_GATTS_EVT = 1, /*arg: esp_gatts_cb_event_t*/
+    SPP_TRACE_RX_WRITE,      /*arg: bytes written by client to data characteristic*/
+    SPP_TRACE_RX_DELIVER,    /*arg: bytes enqueued on downlink and consumer signaled*/
+    SPP_TRACE_APP_WAKEUP,    /*arg: bytes the downlink consumer woke up for*/
+    SPP_TRACE_TX_ENQUEUE,    /*arg: bytes enqueued since the previous release, aux: 1 for a record*/
+    SPP_TRACE_TX_WAKEUP,     /*arg: bytes link_task woke up for*/
+    SPP_TRACE_TX_FRAGMENT,   /*arg: fragment length, aux: fragment number*/
+    SPP_TRACE_TX_DONE,       /*arg: line length*/
+    SPP_TRACE_CONGEST,       /*arg: 1 congested, 0 uncongested*/
+    SPP_TRACE_MARK,          /*arg: free for application use*/
+    SPP_TRACE_REL_ACK,       /*arg: cumulative sequence acknowledged by client*/
+    SPP_TRACE_REL_RETX,      /*arg: first sequence resent, aux: notifications resent*/
+    SPP_TRACE_TX_ERROR,      /*arg: esp_err_t of a failed notification*/
+    SPP_TRACE_ADV_STAGE,     /*aux: advertising stage started, 0xff directed*/
+    SPP_TRACE_RECONNECT,     /*arg: ms from disconnect to connect, saturated*/
+    SPP_TRACE_TX_DROP,       /*arg: bytes a producer write dropped, aux: console_ll_tx_policy_t*/
+    SPP_TRACE_PULL,          /*arg: bytes answered to a read of the data characteristic, aux: 1 for read blob*/
+} spp_trace_evt_t;
+
+#if (SPP_TRACE_ENABLE == 1)
+#define SPP_TRACE(evt, aux, arg) spp_trace_record((evt), (aux), (arg))
+#else
+#define SPP_TRACE(evt, aux, arg) \
+    do {                         \
+    } while (0)
+#endif
+
+void spp_trace_record(uint8_t evt, uint8_t aux, uint16_t arg);
+void spp_trace_dump();
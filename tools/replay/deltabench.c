@@ -0,0 +1,188 @@
+/*Benchmarks spp_delta on a synthetic fleet telemetry stream: bytes per record against the text line a producer would
+  console_printf and against the raw struct, and the encode cost on this host.
+  --out writes the frames as the client receives them in record mode, --expect the lines spp_delta_decode.py should print for them.
+
+  Usage: sppdeltabench [--records N] [--interval K] [--out stream.bin] [--expect lines.txt]
+*/
+
+#include "spp_delta.h"
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    uint32_t uptime_s;
+    int16_t temp_cc;
+    uint16_t hum_pm;
+    uint16_t batt_mv;
+    int8_t rssi;
+    uint8_t state;
+    float pressure_hpa;
+    uint32_t packets;
+    uint16_t errors;
+    int16_t accel_x;
+    int16_t accel_y;
+    int16_t accel_z;
+} bench_sample_t;
+
+static const spp_delta_field_t bench_fields[] = {
+    SPP_DELTA_FIELD(bench_sample_t, uptime_s, SPP_DELTA_U32),
+    SPP_DELTA_FIELD(bench_sample_t, temp_cc, SPP_DELTA_I16),
+    SPP_DELTA_FIELD(bench_sample_t, hum_pm, SPP_DELTA_U16),
+    SPP_DELTA_FIELD(bench_sample_t, batt_mv, SPP_DELTA_U16),
+    SPP_DELTA_FIELD(bench_sample_t, rssi, SPP_DELTA_I8),
+    SPP_DELTA_FIELD(bench_sample_t, state, SPP_DELTA_U8),
+    SPP_DELTA_FIELD(bench_sample_t, pressure_hpa, SPP_DELTA_F32),
+    SPP_DELTA_FIELD(bench_sample_t, packets, SPP_DELTA_U32),
+    SPP_DELTA_FIELD(bench_sample_t, errors, SPP_DELTA_U16),
+    SPP_DELTA_FIELD(bench_sample_t, accel_x, SPP_DELTA_I16),
+    SPP_DELTA_FIELD(bench_sample_t, accel_y, SPP_DELTA_I16),
+    SPP_DELTA_FIELD(bench_sample_t, accel_z, SPP_DELTA_I16),
+};
+#define BENCH_NUM_FIELDS (sizeof(bench_fields) / sizeof(bench_fields[0]))
+
+static uint32_t lcg = 12345;
+
+static int __rand(int range) {
+    lcg = lcg * 1103515245 + 12345;
+    return (int)((lcg >> 16) % (uint32_t)range);
+}
+
+/*One sample a second: slow environment, a noisy radio and accelerometer, counters*/
+static void __next_sample(bench_sample_t *s) {
+    s->uptime_s++;
+    if (0 == __rand(4)) {
+        s->temp_cc += __rand(7) - 3;
+    }
+    if (0 == __rand(6)) {
+        s->hum_pm += __rand(5) - 2;
+    }
+    if (0 == __rand(60)) {
+        s->batt_mv--;
+    }
+    s->rssi = -60 + __rand(9) - 4;
+    if (0 == __rand(300)) {
+        s->state = __rand(4);
+    }
+    if (0 == __rand(10)) {
+        s->pressure_hpa = 1013.25f + (__rand(200) - 100) / 100.0f;
+    }
+    s->packets += __rand(3);
+    if (0 == __rand(500)) {
+        s->errors++;
+    }
+    s->accel_x = __rand(21) - 10;
+    s->accel_y = __rand(21) - 10;
+    s->accel_z = 1000 + __rand(21) - 10;
+}
+
+static int __text_line(const bench_sample_t *s, char *buf, size_t len) {
+    return snprintf(buf, len, "t=%u temp=%d hum=%u batt=%u rssi=%d state=%u p=%.2f pkts=%u err=%u ax=%d ay=%d az=%d\n",
+                    s->uptime_s, s->temp_cc, s->hum_pm, s->batt_mv, s->rssi, s->state, s->pressure_hpa, s->packets, s->errors,
+                    s->accel_x, s->accel_y, s->accel_z);
+}
+
+static void __expect_line(FILE *f, uint8_t seq, const bench_sample_t *s) {
+    fprintf(f, "fleet %u uptime_s=%u temp_cc=%d hum_pm=%u batt_mv=%u rssi=%d state=%u pressure_hpa=%.9g packets=%u errors=%u "
+               "accel_x=%d accel_y=%d accel_z=%d\n",
+            seq, s->uptime_s, s->temp_cc, s->hum_pm, s->batt_mv, s->rssi, s->state, (double)s->pressure_hpa, s->packets, s->errors,
+            s->accel_x, s->accel_y, s->accel_z);
+}
+
+/*Record framing of console_ll, 16bit little endian length*/
+static void __write_record(FILE *f, const uint8_t *buf, size_t len) {
+    uint8_t hdr[2] = {len & 0xff, (len >> 8) & 0xff};
+    fwrite(hdr, 1, sizeof(hdr), f);
+    fwrite(buf, 1, len, f);
+}
+
+int main(int argc, char **argv) {
+    static const struct option opts[] = {
+        {"records", required_argument, NULL, 'n'},
+        {"interval", required_argument, NULL, 'k'},
+        {"out", required_argument, NULL, 'o'},
+        {"expect", required_argument, NULL, 'e'},
+        {NULL, 0, NULL, 0},
+    };
+    spp_delta_schema_t schema = {.name = "fleet", .fields = bench_fields, .num_fields = BENCH_NUM_FIELDS, .keyframe_interval = 32};
+    bench_sample_t s = {.temp_cc = 2150, .hum_pm = 400, .batt_mv = 3900, .pressure_hpa = 1013.25f, .accel_z = 1000};
+    uint8_t frame[CONSOLE_RECORD_MAX_LEN];
+    char line[256];
+    uint32_t records = 10000;
+    uint64_t text_bytes = 0, delta_bytes = 0, encode_ns = 0;
+    uint64_t hist[4] = {0};
+    FILE *out = NULL;
+    FILE *expect = NULL;
+    struct timespec t0, t1;
+    spp_delta_stats_t stats;
+    uint64_t raw_bytes;
+    size_t len;
+    int id, opt;
+
+    while ((opt = getopt_long(argc, argv, "n:k:o:e:", opts, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            records = (uint32_t)atoi(optarg);
+            break;
+        case 'k':
+            schema.keyframe_interval = (uint16_t)atoi(optarg);
+            break;
+        case 'o':
+            out = fopen(optarg, "wb");
+            break;
+        case 'e':
+            expect = fopen(optarg, "w");
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [--records N] [--interval K] [--out stream.bin] [--expect lines.txt]\n", argv[0]);
+            return 1;
+        }
+    }
+    id = spp_delta_register(&schema);
+    if (id < 0) {
+        return 1;
+    }
+    len = spp_delta_schema_frame(id, frame, sizeof(frame));
+    delta_bytes += len + 2;
+    if (out) {
+        __write_record(out, frame, len);
+    }
+    for (uint32_t i = 0; i < records; i++) {
+        __next_sample(&s);
+        text_bytes += __text_line(&s, line, sizeof(line));
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        len = spp_delta_encode(id, &s, frame, sizeof(frame));
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        encode_ns += (t1.tv_sec - t0.tv_sec) * 1000000000ull + t1.tv_nsec - t0.tv_nsec;
+        delta_bytes += len + 2;
+        hist[(len < 8) ? 0 : (len < 16) ? 1 : (len < 32) ? 2 : 3]++;
+        if (out) {
+            __write_record(out, frame, len);
+        }
+        if (expect) {
+            __expect_line(expect, (uint8_t)i, &s);
+        }
+    }
+    if (out) {
+        fclose(out);
+    }
+    if (expect) {
+        fclose(expect);
+    }
+    /*Field bytes plus the record header, what sending the struct with console_ll_send_record costs*/
+    spp_delta_get_stats(id, &stats);
+    raw_bytes = stats.raw_bytes + (uint64_t)records * 2;
+    printf("records                %u, %zu fields, keyframe every %u\n", records, BENCH_NUM_FIELDS, schema.keyframe_interval);
+    printf("text lines             %llu bytes, %.1f per record\n", (unsigned long long)text_bytes, (double)text_bytes / records);
+    printf("raw records            %llu bytes, %.1f per record with record header\n", (unsigned long long)raw_bytes,
+           (double)raw_bytes / records);
+    printf("delta records          %llu bytes, %.1f per record with record header, %u keyframes\n", (unsigned long long)delta_bytes,
+           (double)delta_bytes / records, stats.keyframes);
+    printf("frame sizes            <8: %llu  8-15: %llu  16-31: %llu  >=32: %llu\n", (unsigned long long)hist[0],
+           (unsigned long long)hist[1], (unsigned long long)hist[2], (unsigned long long)hist[3]);
+    printf("saved                  %.1f x against text, %.1f x against raw records\n", (double)text_bytes / delta_bytes,
+           (double)raw_bytes / delta_bytes);
+    printf("encode                 %.0f ns per record on this host\n", (double)encode_ns / records);
+    return 0;
+}
@@ -0,0 +1,440 @@
+/*Replays a capture from spp_capture through console_ll and ble_spp_server on Linux.
+  Downlink chunks become GATTS writes on the data characteristic, producer chunks are written with console_ll_write
+  under --policy, blocking by default (or console_ll_send_record in record mode), notifications leaving ble_spp_server
+  are counted and timed. With --pull the client switches to pull mode and drains the uplink with long reads instead.
+  Downlink writes the consumer cannot keep up with are dropped by console_ll and counted, --pace holds them back instead.
+
+  Usage: sppreplay [--fast] [--record] [--mtu N] [--policy block|nonblock|drop-oldest|drop-newest] [--pull] [--pace] capture.sppcap
+*/
+
+#include "ble_spp_server.h"
+#include "console_ll.h"
+#include "esp_gatts_api.h"
+#include "spp_capture.h"
+#include <getopt.h>
+#include <unistd.h>
+
+#define SPPCAP_MAGIC "SPPCAP01"
+#define SPPCAP_HDR_LEN (7)
+#define REPLAY_DRAIN_TIMEOUT_MS (5000)
+#define REPLAY_MAX_SAMPLES (1 << 16)
+#define REPLAY_PULL_IDLE_US (1000) /*Between reads that found the uplink empty*/
+
+typedef struct {
+    uint32_t ts_us;
+    uint8_t dir;
+    uint16_t len;
+    const uint8_t *data;
+} replay_chunk_t;
+
+/*Byte offset at which a chunk ends and the time it entered the link, latency is taken when the other end passes the offset*/
+typedef struct {
+    uint64_t end;
+    int64_t t_us;
+} replay_mark_t;
+
+typedef struct {
+    replay_mark_t marks[REPLAY_MAX_SAMPLES];
+    size_t head;
+    size_t tail;
+    uint64_t done;
+    uint32_t lat_us[REPLAY_MAX_SAMPLES];
+    size_t n_lat;
+    pthread_mutex_t lock;
+} replay_flow_t;
+
+static replay_flow_t uplink = {.lock = PTHREAD_MUTEX_INITIALIZER};
+static replay_flow_t downlink = {.lock = PTHREAD_MUTEX_INITIALIZER};
+static uint64_t uplink_enqueued = 0;
+static uint64_t downlink_written = 0;
+static uint32_t notifications = 0;
+static uint64_t notified_bytes = 0;
+static bool record_mode = false;
+static bool pull_mode = false;
+static bool pace = false;
+static uint16_t pull_mtu;
+static volatile uint16_t pull_rsp_len;
+static uint32_t pull_reads = 0;
+static uint64_t pull_bytes = 0;
+static console_ll_tx_policy_t tx_policy = CONSOLE_LL_TX_BLOCK;
+static SemaphoreHandle_t downlink_sem;
+static volatile size_t downlink_pending = 0;
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void __flow_mark(replay_flow_t *flow, uint64_t end) {
+    pthread_mutex_lock(&flow->lock);
+    if ((flow->tail - flow->head) < REPLAY_MAX_SAMPLES) {
+        flow->marks[flow->tail % REPLAY_MAX_SAMPLES] = (replay_mark_t){.end = end, .t_us = esp_timer_get_time()};
+        flow->tail++;
+    }
+    pthread_mutex_unlock(&flow->lock);
+}
+
+static void __flow_advance(replay_flow_t *flow, uint64_t bytes) {
+    int64_t now = esp_timer_get_time();
+    pthread_mutex_lock(&flow->lock);
+    flow->done += bytes;
+    while ((flow->head != flow->tail) && (flow->marks[flow->head % REPLAY_MAX_SAMPLES].end <= flow->done)) {
+        if (flow->n_lat < REPLAY_MAX_SAMPLES) {
+            flow->lat_us[flow->n_lat++] = (uint32_t)(now - flow->marks[flow->head % REPLAY_MAX_SAMPLES].t_us);
+        }
+        flow->head++;
+    }
+    pthread_mutex_unlock(&flow->lock);
+}
+
+static uint64_t __flow_done(replay_flow_t *flow) {
+    uint64_t done;
+    pthread_mutex_lock(&flow->lock);
+    done = flow->done;
+    pthread_mutex_unlock(&flow->lock);
+    return done;
+}
+
+/*Strips the '##' total current header link_task puts on fragments of text lines longer than one notification, record mode has none*/
+static void on_notify(uint16_t handle, const uint8_t *value, uint16_t len) {
+    uint16_t payload = len;
+    if (handle != (SHIM_ATTR_HANDLE_BASE + SPP_IDX_SPP_DATA_NTY_VAL)) {
+        return;
+    }
+    if (!record_mode && (len >= 4) && (value[0] == '#') && (value[1] == '#') && (value[2] > 1) && (value[3] >= 1) && (value[3] <= value[2])) {
+        payload = len - 4;
+    }
+    notifications++;
+    notified_bytes += len;
+    __flow_advance(&uplink, payload);
+}
+
+static void on_response(esp_gatt_status_t status, const esp_gatt_rsp_t *rsp) {
+    pull_rsp_len = (ESP_GATT_OK == status) ? rsp->attr_value.len : 0;
+    pull_reads++;
+    pull_bytes += pull_rsp_len;
+    __flow_advance(&uplink, pull_rsp_len);
+}
+
+static void __post_read(uint16_t offset) {
+    esp_ble_gatts_cb_param_t p = {.read = {.conn_id = 0, .handle = SHIM_ATTR_HANDLE_BASE + SPP_IDX_SPP_DATA_NTY_VAL, .offset = offset,
+                                           .is_long = (offset > 0), .need_rsp = true}};
+    shim_bt_post(ESP_GATTS_READ_EVT, &p);
+    shim_bt_sync();
+}
+
+/*Reads the data characteristic the way a central does a long read: read, then read blob while responses are full*/
+static void puller_task(void *arg) {
+    uint16_t offset;
+    for (;;) {
+        offset = 0;
+        do {
+            __post_read(offset);
+            offset += pull_rsp_len;
+        } while (pull_rsp_len == (pull_mtu - 1));
+        if (0 == offset) {
+            usleep(REPLAY_PULL_IDLE_US);
+        }
+    }
+}
+
+static void on_downlink(size_t num_elements) {
+    pthread_mutex_lock(&pending_lock);
+    downlink_pending += num_elements;
+    pthread_mutex_unlock(&pending_lock);
+    xSemaphoreGive(downlink_sem);
+}
+
+/*Drains the downlink the way main.c does*/
+static void consumer_task(void *arg) {
+    uint8_t rec[CONSOLE_RECORD_MAX_LEN];
+    size_t n;
+    for (;;) {
+        xSemaphoreTake(downlink_sem, portMAX_DELAY);
+        if (record_mode) {
+            while ((n = console_ll_recv_record(rec, sizeof(rec), 0)) > 0) {
+                __flow_advance(&downlink, n + CONSOLE_RECORD_HDR_LEN);
+            }
+            continue;
+        }
+        pthread_mutex_lock(&pending_lock);
+        n = downlink_pending;
+        downlink_pending = 0;
+        pthread_mutex_unlock(&pending_lock);
+        for (size_t i = 0; i < n; i++) {
+            console_ll_getc(GETC_BLOCK);
+        }
+        __flow_advance(&downlink, n);
+    }
+}
+
+static int __cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void __report_latency(const char *name, replay_flow_t *flow) {
+    size_t n = flow->n_lat;
+    if (0 == n) {
+        printf("%-22s no samples\n", name);
+        return;
+    }
+    qsort(flow->lat_us, n, sizeof(uint32_t), __cmp_u32);
+    printf("%-22s n=%-6zu p50=%-8u p90=%-8u p99=%-8u max=%-8u us\n", name, n, flow->lat_us[n / 2], flow->lat_us[(n * 9) / 10],
+           flow->lat_us[(n * 99) / 100], flow->lat_us[n - 1]);
+}
+
+static uint8_t *__load(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    uint8_t *buf;
+    long size;
+    if (NULL == f) {
+        perror(path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buf = malloc(size);
+    if ((size < (long)strlen(SPPCAP_MAGIC)) || (fread(buf, 1, size, f) != (size_t)size) || memcmp(buf, SPPCAP_MAGIC, strlen(SPPCAP_MAGIC))) {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        exit(1);
+    }
+    fclose(f);
+    *len = size;
+    return buf;
+}
+
+static size_t __parse(const uint8_t *buf, size_t len, replay_chunk_t **out) {
+    size_t off = strlen(SPPCAP_MAGIC);
+    size_t n = 0;
+    replay_chunk_t *chunks = NULL;
+    while ((off + SPPCAP_HDR_LEN) <= len) {
+        replay_chunk_t c = {
+            .ts_us = buf[off] | (buf[off + 1] << 8) | (buf[off + 2] << 16) | ((uint32_t)buf[off + 3] << 24),
+            .dir = buf[off + 4],
+            .len = buf[off + 5] | (buf[off + 6] << 8),
+            .data = &buf[off + SPPCAP_HDR_LEN],
+        };
+        if ((off + SPPCAP_HDR_LEN + c.len) > len) {
+            fprintf(stderr, "Truncated chunk at offset %zu\n", off);
+            break;
+        }
+        chunks = realloc(chunks, (n + 1) * sizeof(*chunks));
+        chunks[n++] = c;
+        off += SPPCAP_HDR_LEN + c.len;
+    }
+    *out = chunks;
+    return n;
+}
+
+static void __post_write(uint16_t idx, const uint8_t *value, uint16_t len) {
+    esp_ble_gatts_cb_param_t p = {.write = {.conn_id = 0, .handle = SHIM_ATTR_HANDLE_BASE + idx, .len = len, .value = (uint8_t *)value}};
+    shim_bt_post(ESP_GATTS_WRITE_EVT, &p);
+}
+
+static void __connect(uint16_t mtu) {
+    esp_ble_gatts_cb_param_t p = {.connect = {.conn_id = 0, .remote_bda = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01}}};
+    const uint8_t ntf_on[2] = {0x01, 0x00};
+    shim_bt_post(ESP_GATTS_CONNECT_EVT, &p);
+    p = (esp_ble_gatts_cb_param_t){.mtu = {.conn_id = 0, .mtu = mtu}};
+    shim_bt_post(ESP_GATTS_MTU_EVT, &p);
+    __post_write(SPP_IDX_SPP_DATA_NTF_CFG, ntf_on, sizeof(ntf_on));
+    if (pull_mode) {
+        __post_write(SPP_IDX_SPP_COMMAND_VAL, (const uint8_t *)"PULL1", 5);
+    }
+    shim_bt_sync();
+    /*Commands are handled after a delay and applied by link_task, reads before that would find pull mode off*/
+    for (int64_t t = esp_timer_get_time(); pull_mode && !ble_spp_pull_active(); usleep(1000)) {
+        if ((esp_timer_get_time() - t) > (REPLAY_DRAIN_TIMEOUT_MS * 1000)) {
+            fprintf(stderr, "Pull mode not active %d ms after PULL1\n", REPLAY_DRAIN_TIMEOUT_MS);
+            exit(2);
+        }
+    }
+}
+
+static void __stalled(void) {
+    fprintf(stderr, "Uplink stalled with %llu bytes not notified for %d ms\n",
+            (unsigned long long)(uplink_enqueued - __flow_done(&uplink)), REPLAY_DRAIN_TIMEOUT_MS);
+    exit(2);
+}
+
+/*With --pace, keeps what is written but not consumed within the text downlink queue, like a client that waits for replies.
+  Without it writes are posted as captured and whatever does not fit is dropped*/
+static void __pace_downlink(size_t len) {
+    int64_t t = esp_timer_get_time();
+    uint64_t pending;
+    while (pace && !record_mode && ((pending = downlink_written - __flow_done(&downlink)) > 0) && ((pending + len) > CONSOLE_PRINT_SIZE)) {
+        if ((esp_timer_get_time() - t) > (REPLAY_DRAIN_TIMEOUT_MS * 1000)) {
+            fprintf(stderr, "Downlink stalled with %llu bytes not consumed for %d ms\n", (unsigned long long)pending, REPLAY_DRAIN_TIMEOUT_MS);
+            exit(2);
+        }
+        usleep(100);
+    }
+}
+
+/*Bytes are marked before the write so a notification can never overtake its mark, latency includes the wait for room.
+  Under the drop policies the marks no longer match the notified bytes one to one and latency is approximate*/
+static void __produce(const replay_chunk_t *c) {
+    size_t n;
+    if (record_mode) {
+        __flow_mark(&uplink, uplink_enqueued + c->len + CONSOLE_RECORD_HDR_LEN);
+        if (ESP_OK != console_ll_send_record(c->data, c->len, pdMS_TO_TICKS(REPLAY_DRAIN_TIMEOUT_MS))) {
+            __stalled();
+        }
+        uplink_enqueued += c->len + CONSOLE_RECORD_HDR_LEN;
+        return;
+    }
+    __flow_mark(&uplink, uplink_enqueued + c->len);
+    n = console_ll_write(c->data, c->len, tx_policy, pdMS_TO_TICKS(REPLAY_DRAIN_TIMEOUT_MS));
+    if ((CONSOLE_LL_TX_BLOCK == tx_policy) && (n < c->len)) {
+        __stalled();
+    }
+    uplink_enqueued += n;
+}
+
+int main(int argc, char **argv) {
+    static const struct option opts[] = {
+        {"fast", no_argument, NULL, 'f'},
+        {"record", no_argument, NULL, 'r'},
+        {"mtu", required_argument, NULL, 'm'},
+        {"policy", required_argument, NULL, 'p'},
+        {"pull", no_argument, NULL, 'P'},
+        {"pace", no_argument, NULL, 'd'},
+        {NULL, 0, NULL, 0},
+    };
+    bool fast = false;
+    uint16_t mtu = 185;
+    int opt;
+    size_t len, n;
+    uint8_t *file;
+    replay_chunk_t *chunks;
+    uint64_t captured_uplink = 0;
+    uint32_t captured_pulls = 0;
+    int64_t start, elapsed;
+
+    static const char *policies[] = {"block", "nonblock", "drop-oldest", "drop-newest"};
+    console_ll_tx_stats_t tx_stats;
+    uint64_t expected = 0;
+    uint64_t downlink_expected = 0;
+
+    while ((opt = getopt_long(argc, argv, "frm:p:Pd", opts, NULL)) != -1) {
+        switch (opt) {
+        case 'f':
+            fast = true;
+            break;
+        case 'r':
+            record_mode = true;
+            break;
+        case 'm':
+            mtu = (uint16_t)atoi(optarg);
+            break;
+        case 'P':
+            pull_mode = true;
+            break;
+        case 'd':
+            pace = true;
+            break;
+        case 'p':
+            for (opt = 0; (opt < 4) && (0 != strcmp(optarg, policies[opt])); opt++) {
+            }
+            if (4 == opt) {
+                fprintf(stderr, "Unknown policy %s\n", optarg);
+                return 1;
+            }
+            tx_policy = (console_ll_tx_policy_t)opt;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [--fast] [--record] [--mtu N] [--policy block|nonblock|drop-oldest|drop-newest] [--pull] [--pace] capture.sppcap\n", argv[0]);
+            return 1;
+        }
+    }
+#if (SPP_PULL_UPLINK == 0)
+    if (pull_mode) {
+        fprintf(stderr, "--pull needs SPP_PULL_UPLINK set in spp_config.h\n");
+        return 1;
+    }
+#endif
+    if (optind >= argc) {
+        fprintf(stderr, "Usage: %s [--fast] [--record] [--mtu N] [--policy block|nonblock|drop-oldest|drop-newest] [--pull] [--pace] capture.sppcap\n", argv[0]);
+        return 1;
+    }
+    file = __load(argv[optind], &len);
+    n = __parse(file, len, &chunks);
+    if (0 == n) {
+        fprintf(stderr, "Empty capture\n");
+        return 1;
+    }
+
+    downlink_sem = xSemaphoreCreateBinary();
+    shim_bt_set_notify_hook(on_notify);
+    shim_bt_set_response_hook(on_response);
+    if (record_mode) {
+        console_ll_set_mode(CONSOLE_LL_MODE_RECORD);
+    }
+    console_ll_init(on_downlink);
+    while (!shim_bt_ready()) {
+        usleep(1000);
+    }
+    shim_bt_sync();
+    __connect(mtu);
+    xTaskCreate(consumer_task, "consumer", 0, NULL, 0, NULL);
+    if (pull_mode) {
+        pull_mtu = mtu;
+        xTaskCreate(puller_task, "puller", 0, NULL, 0, NULL);
+    }
+
+    start = esp_timer_get_time();
+    for (size_t i = 0; i < n; i++) {
+        const replay_chunk_t *c = &chunks[i];
+        if (!fast) {
+            int64_t due = start + (int64_t)(uint32_t)(c->ts_us - chunks[0].ts_us);
+            int64_t now = esp_timer_get_time();
+            if (due > now) {
+                usleep((useconds_t)(due - now));
+            }
+        }
+        switch (c->dir) {
+        case SPP_CAPTURE_DOWNLINK:
+            __pace_downlink(c->len);
+            downlink_written += c->len;
+            __flow_mark(&downlink, downlink_written);
+            __post_write(SPP_IDX_SPP_DATA_RECV_VAL, c->data, c->len);
+            break;
+        case SPP_CAPTURE_PRODUCER:
+            __produce(c);
+            break;
+        case SPP_CAPTURE_UPLINK:
+            captured_uplink += c->len;
+            captured_pulls++;
+            break;
+        default:
+            break;
+        }
+    }
+
+    /*Let the link drain, bytes dropped as oldest were accepted but never leave and dropped downlink bytes never arrive*/
+    for (int64_t t = esp_timer_get_time(); (esp_timer_get_time() - t) < (REPLAY_DRAIN_TIMEOUT_MS * 1000);) {
+        console_ll_get_tx_stats(&tx_stats);
+        expected = uplink_enqueued - tx_stats.dropped_oldest;
+        downlink_expected = downlink_written - console_ll_get_rx_dropped();
+        if ((__flow_done(&uplink) >= expected) && (__flow_done(&downlink) >= downlink_expected)) {
+            break;
+        }
+        usleep(1000);
+    }
+    elapsed = esp_timer_get_time() - start;
+
+    printf("chunks                 %zu in %.3f s (%s)\n", n, elapsed / 1e6, fast ? "fast" : "original timing");
+    printf("downlink               %llu bytes written, %llu consumed, %u dropped\n", (unsigned long long)downlink_written,
+           (unsigned long long)__flow_done(&downlink), console_ll_get_rx_dropped());
+    printf("uplink                 %llu bytes produced, %llu delivered\n", (unsigned long long)uplink_enqueued, (unsigned long long)__flow_done(&uplink));
+    printf("notifications          %u, %llu bytes on air, %.1f bytes each\n", notifications, (unsigned long long)notified_bytes,
+           notifications ? (double)notified_bytes / notifications : 0.0);
+    printf("pulled                 %llu bytes in %u reads, %.1f bytes each\n", (unsigned long long)pull_bytes, pull_reads,
+           pull_reads ? (double)pull_bytes / pull_reads : 0.0);
+    printf("tx policy              %s, %u waits, %u short writes, %u oldest and %u newest bytes dropped\n", policies[tx_policy],
+           tx_stats.waits, tx_stats.short_writes, tx_stats.dropped_oldest, tx_stats.dropped_newest);
+    printf("captured uplink        %llu bytes in %u pulls\n", (unsigned long long)captured_uplink, captured_pulls);
+    printf("uplink throughput      %.0f bytes/s\n", elapsed ? __flow_done(&uplink) * 1e6 / elapsed : 0.0);
+    __report_latency("write -> consumer", &downlink);
+    __report_latency("produce -> notify", &uplink);
+    return ((__flow_done(&uplink) >= expected) && (__flow_done(&downlink) >= downlink_expected)) ? 0 : 3;
+}
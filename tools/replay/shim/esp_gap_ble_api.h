@@ -0,0 +1,91 @@
+#pragma once
+#include "shim.h"
+typedef uint8_t esp_bd_addr_t[6];
+#define ESP_BLE_ADV_DATA_LEN_MAX 31
+#define ESP_BLE_SCAN_RSP_DATA_LEN_MAX 31
+#define ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE 0xFF
+typedef enum {
+    BLE_ADDR_TYPE_PUBLIC = 0,
+    BLE_ADDR_TYPE_RANDOM,
+    BLE_ADDR_TYPE_RPA_PUBLIC,
+    BLE_ADDR_TYPE_RPA_RANDOM,
+} esp_ble_addr_type_t;
+typedef enum {
+    ADV_TYPE_IND = 0,
+    ADV_TYPE_DIRECT_IND_HIGH,
+    ADV_TYPE_SCAN_IND,
+    ADV_TYPE_NONCONN_IND,
+    ADV_TYPE_DIRECT_IND_LOW,
+} esp_ble_adv_type_t;
+typedef enum {
+    ADV_CHNL_37 = 1,
+    ADV_CHNL_38 = 2,
+    ADV_CHNL_39 = 4,
+    ADV_CHNL_ALL = 7,
+} esp_ble_adv_channel_t;
+typedef enum {
+    ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY = 0,
+    ADV_FILTER_ALLOW_SCAN_WLST_CON_ANY,
+    ADV_FILTER_ALLOW_SCAN_ANY_CON_WLST,
+    ADV_FILTER_ALLOW_SCAN_WLST_CON_WLST,
+} esp_ble_adv_filter_t;
+typedef struct {
+    uint16_t adv_int_min;
+    uint16_t adv_int_max;
+    esp_ble_adv_type_t adv_type;
+    esp_ble_addr_type_t own_addr_type;
+    esp_bd_addr_t peer_addr;
+    esp_ble_addr_type_t peer_addr_type;
+    esp_ble_adv_channel_t channel_map;
+    esp_ble_adv_filter_t adv_filter_policy;
+} esp_ble_adv_params_t;
+typedef enum {
+    ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT = 0,
+    ESP_GAP_BLE_SCAN_RSP_DATA_SET_COMPLETE_EVT,
+    ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT,
+    ESP_GAP_BLE_SCAN_RESULT_EVT,
+    ESP_GAP_BLE_ADV_DATA_RAW_SET_COMPLETE_EVT,
+    ESP_GAP_BLE_SCAN_RSP_DATA_RAW_SET_COMPLETE_EVT,
+    ESP_GAP_BLE_ADV_START_COMPLETE_EVT,
+    ESP_GAP_BLE_SCAN_START_COMPLETE_EVT,
+    ESP_GAP_BLE_AUTH_CMPL_EVT,
+    ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT = 17,
+    ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT = 20,
+    ESP_GAP_BLE_REMOVE_BOND_DEV_COMPLETE_EVT = 22,
+} esp_gap_ble_cb_event_t;
+typedef uint8_t esp_bt_status_t;
+#define ESP_BT_STATUS_SUCCESS 0
+typedef struct {
+    esp_bd_addr_t bd_addr;
+    bool success;
+    esp_ble_addr_type_t addr_type;
+} esp_ble_auth_cmpl_t;
+typedef union {
+    struct {
+        esp_bt_status_t status;
+    } adv_data_raw_cmpl;
+    struct {
+        esp_bt_status_t status;
+    } scan_rsp_data_raw_cmpl;
+    struct {
+        esp_bt_status_t status;
+    } adv_start_cmpl;
+    struct {
+        esp_bt_status_t status;
+    } adv_stop_cmpl;
+    struct {
+        esp_ble_auth_cmpl_t auth_cmpl;
+    } ble_security;
+    struct {
+        esp_bt_status_t status;
+        esp_bd_addr_t bd_addr;
+    } remove_bond_dev_cmpl;
+} esp_ble_gap_cb_param_t;
+typedef void (*esp_gap_ble_cb_t)(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t cb);
+esp_err_t esp_ble_gap_set_device_name(const char *name);
+esp_err_t esp_ble_gap_config_adv_data_raw(uint8_t *data, uint32_t len);
+esp_err_t esp_ble_gap_config_scan_rsp_data_raw(uint8_t *data, uint32_t len);
+esp_err_t esp_ble_gap_start_advertising(esp_ble_adv_params_t *params);
+esp_err_t esp_ble_gap_stop_advertising(void);
+esp_err_t esp_ble_gap_disconnect(esp_bd_addr_t addr);
@@ -0,0 +1,171 @@
+#pragma once
+#include "esp_gap_ble_api.h"
+#include "shim.h"
+typedef uint8_t esp_gatt_if_t;
+#define ESP_GATT_IF_NONE 0xff
+#define ESP_GATT_AUTO_RSP 1
+#define ESP_GATT_RSP_BY_APP 0
+#define ESP_UUID_LEN_16 2
+#define ESP_GATT_PERM_READ (1 << 0)
+#define ESP_GATT_PERM_WRITE (1 << 4)
+#define ESP_GATT_CHAR_PROP_BIT_READ (1 << 1)
+#define ESP_GATT_CHAR_PROP_BIT_WRITE_NR (1 << 2)
+#define ESP_GATT_CHAR_PROP_BIT_WRITE (1 << 3)
+#define ESP_GATT_CHAR_PROP_BIT_NOTIFY (1 << 4)
+#define ESP_GATT_CHAR_PROP_BIT_INDICATE (1 << 5)
+#define ESP_GATT_UUID_PRI_SERVICE 0x2800
+#define ESP_GATT_UUID_CHAR_DECLARE 0x2803
+#define ESP_GATT_UUID_CHAR_CLIENT_CONFIG 0x2902
+#define ESP_GATT_MAX_ATTR_LEN 600
+typedef uint16_t esp_gatt_perm_t;
+typedef uint8_t esp_gatt_char_prop_t;
+typedef struct {
+    uint16_t len;
+    union {
+        uint16_t uuid16;
+    } uuid;
+} esp_bt_uuid_t;
+typedef struct {
+    int unused;
+} esp_gatt_srvc_id_t;
+typedef struct {
+    uint8_t auto_rsp;
+} esp_attr_control_t;
+typedef struct {
+    uint16_t uuid_length;
+    uint8_t *uuid_p;
+    uint16_t perm;
+    uint16_t max_length;
+    uint16_t length;
+    uint8_t *value;
+} esp_attr_desc_t;
+typedef struct {
+    esp_attr_control_t attr_control;
+    esp_attr_desc_t att_desc;
+} esp_gatts_attr_db_t;
+typedef enum {
+    ESP_GATT_OK = 0,
+    ESP_GATT_INVALID_HANDLE = 0x01,
+    ESP_GATT_READ_NOT_PERMIT = 0x02,
+    ESP_GATT_INVALID_OFFSET = 0x07,
+    ESP_GATT_INVALID_ATTR_LEN = 0x0d,
+    ESP_GATT_CONGESTED = 0x8f,
+} esp_gatt_status_t;
+typedef enum {
+    ESP_GATTS_REG_EVT = 0,
+    ESP_GATTS_READ_EVT = 1,
+    ESP_GATTS_WRITE_EVT = 2,
+    ESP_GATTS_EXEC_WRITE_EVT = 3,
+    ESP_GATTS_MTU_EVT = 4,
+    ESP_GATTS_CONF_EVT = 5,
+    ESP_GATTS_UNREG_EVT = 6,
+    ESP_GATTS_CREATE_EVT = 7,
+    ESP_GATTS_ADD_INCL_SRVC_EVT = 8,
+    ESP_GATTS_ADD_CHAR_EVT = 9,
+    ESP_GATTS_ADD_CHAR_DESCR_EVT = 10,
+    ESP_GATTS_DELETE_EVT = 11,
+    ESP_GATTS_START_EVT = 12,
+    ESP_GATTS_STOP_EVT = 13,
+    ESP_GATTS_CONNECT_EVT = 14,
+    ESP_GATTS_DISCONNECT_EVT = 15,
+    ESP_GATTS_OPEN_EVT = 16,
+    ESP_GATTS_CANCEL_OPEN_EVT = 17,
+    ESP_GATTS_CLOSE_EVT = 18,
+    ESP_GATTS_LISTEN_EVT = 19,
+    ESP_GATTS_CONGEST_EVT = 20,
+    ESP_GATTS_RESPONSE_EVT = 21,
+    ESP_GATTS_CREAT_ATTR_TAB_EVT = 22,
+} esp_gatts_cb_event_t;
+typedef union {
+    struct {
+        esp_gatt_status_t status;
+        uint16_t app_id;
+    } reg;
+    struct {
+        uint16_t conn_id;
+        uint32_t trans_id;
+        esp_bd_addr_t bda;
+        uint16_t handle;
+        uint16_t offset;
+        bool is_long;
+        bool need_rsp;
+    } read;
+    struct {
+        uint16_t conn_id;
+        uint32_t trans_id;
+        esp_bd_addr_t bda;
+        uint16_t handle;
+        uint16_t offset;
+        bool need_rsp;
+        bool is_prep;
+        uint16_t len;
+        uint8_t *value;
+    } write;
+    struct {
+        uint16_t conn_id;
+        uint32_t trans_id;
+        esp_bd_addr_t bda;
+        uint8_t exec_write_flag;
+    } exec_write;
+    struct {
+        uint16_t conn_id;
+        uint16_t mtu;
+    } mtu;
+    struct {
+        esp_gatt_status_t status;
+        uint16_t conn_id;
+        uint16_t handle;
+        uint16_t len;
+        uint8_t *value;
+    } conf;
+    struct {
+        uint16_t conn_id;
+        uint8_t link_role;
+        esp_bd_addr_t remote_bda;
+    } connect;
+    struct {
+        uint16_t conn_id;
+        esp_bd_addr_t remote_bda;
+        int reason;
+    } disconnect;
+    struct {
+        uint16_t conn_id;
+        bool congested;
+    } congest;
+    struct {
+        esp_gatt_status_t status;
+        uint16_t num_handle;
+        uint16_t *handles;
+    } add_attr_tab;
+} esp_ble_gatts_cb_param_t;
+typedef struct {
+    uint16_t handle;
+    uint16_t offset;
+    uint16_t len;
+    uint8_t auth_req;
+    uint8_t value[ESP_GATT_MAX_ATTR_LEN];
+} esp_gatt_value_t;
+typedef union {
+    esp_gatt_value_t attr_value;
+    uint16_t handle;
+} esp_gatt_rsp_t;
+typedef void (*esp_gatts_cb_t)(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
+esp_err_t esp_ble_gatts_register_callback(esp_gatts_cb_t cb);
+esp_err_t esp_ble_gatts_app_register(uint16_t app_id);
+esp_err_t esp_ble_gatts_create_attr_tab(const esp_gatts_attr_db_t *db, esp_gatt_if_t gatts_if, uint8_t max_nb_attr, uint8_t srvc_inst_id);
+esp_err_t esp_ble_gatts_start_service(uint16_t handle);
+esp_err_t esp_ble_gatts_send_indicate(esp_gatt_if_t gatts_if, uint16_t conn_id, uint16_t handle, uint16_t len, uint8_t *value, bool need_confirm);
+esp_err_t esp_ble_gatts_send_response(esp_gatt_if_t gatts_if, uint16_t conn_id, uint32_t trans_id, esp_gatt_status_t status, esp_gatt_rsp_t *rsp);
+esp_err_t esp_ble_gatts_set_attr_value(uint16_t handle, uint16_t len, const uint8_t *value);
+
+/*Fake stack side, used by the replay driver*/
+#define SHIM_ATTR_HANDLE_BASE (40)
+typedef void (*shim_notify_hook_t)(uint16_t handle, const uint8_t *value, uint16_t len);
+void shim_bt_set_notify_hook(shim_notify_hook_t hook);
+typedef void (*shim_response_hook_t)(esp_gatt_status_t status, const esp_gatt_rsp_t *rsp);
+void shim_bt_set_response_hook(shim_response_hook_t hook);
+/*Queues a GATTS event for the fake BTC task, write values are copied*/
+void shim_bt_post(esp_gatts_cb_event_t event, esp_ble_gatts_cb_param_t *param);
+/*Blocks until every posted event has been handled*/
+void shim_bt_sync(void);
+bool shim_bt_ready(void);
@@ -0,0 +1,700 @@
+/*POSIX implementation of shim.h and a fake bluedroid GATT server for the replay driver.
+  Callbacks run on one "btc" thread like on the device, notifications go to the hook installed by the driver.
+*/
+
+#include "esp_bt.h"
+#include "esp_gatts_api.h"
+#include "shim.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+
+/*Time*/
+static int64_t __now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t shim_t0 = 0;
+
+int64_t esp_timer_get_time(void) {
+    if (0 == shim_t0) {
+        shim_t0 = __now_us();
+    }
+    return __now_us() - shim_t0;
+}
+
+/*esp_timer, one thread per timer*/
+struct shim_timer {
+    esp_timer_create_args_t args;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int64_t due_us;
+    uint64_t period_us;
+    bool armed;
+};
+
+static void *__timer_thread(void *arg) {
+    struct shim_timer *t = arg;
+    pthread_mutex_lock(&t->lock);
+    for (;;) {
+        if (!t->armed) {
+            pthread_cond_wait(&t->cond, &t->lock);
+            continue;
+        }
+        int64_t wait_us = t->due_us - esp_timer_get_time();
+        if (wait_us > 0) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += wait_us / 1000000;
+            ts.tv_nsec += (wait_us % 1000000) * 1000;
+            if (ts.tv_nsec >= 1000000000) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&t->cond, &t->lock, &ts);
+            continue;
+        }
+        if (t->period_us) {
+            t->due_us += t->period_us;
+        } else {
+            t->armed = false;
+        }
+        pthread_mutex_unlock(&t->lock);
+        t->args.callback(t->args.arg);
+        pthread_mutex_lock(&t->lock);
+    }
+    return NULL;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out) {
+    struct shim_timer *t = calloc(1, sizeof(*t));
+    t->args = *args;
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->cond, NULL);
+    pthread_create(&t->thread, NULL, __timer_thread, t);
+    *out = t;
+    return ESP_OK;
+}
+
+static esp_err_t __timer_arm(esp_timer_handle_t t, uint64_t us, uint64_t period_us) {
+    pthread_mutex_lock(&t->lock);
+    if (t->armed) {
+        pthread_mutex_unlock(&t->lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    t->due_us = esp_timer_get_time() + us;
+    t->period_us = period_us;
+    t->armed = true;
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us) {
+    return __timer_arm(timer, period_us, period_us);
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return __timer_arm(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    esp_err_t rc = ESP_OK;
+    pthread_mutex_lock(&timer->lock);
+    if (!timer->armed) {
+        rc = ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = false;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+    return rc;
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+static void __deadline(struct timespec *ts, TickType_t ticks) {
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += ticks / 1000;
+    ts->tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+/*Waits on cond until pred or timeout, mutex held. Returns pred*/
+#define SHIM_WAIT(cond, mutex, ticks, pred)                              \
+    ({                                                                   \
+        struct timespec __ts;                                            \
+        int __rc = 0;                                                    \
+        if ((ticks) != portMAX_DELAY) {                                  \
+            __deadline(&__ts, (ticks));                                  \
+        }                                                                \
+        while (!(pred) && (ticks) != 0 && __rc != ETIMEDOUT) {           \
+            if ((ticks) == portMAX_DELAY) {                              \
+                pthread_cond_wait((cond), (mutex));                      \
+            } else {                                                     \
+                __rc = pthread_cond_timedwait((cond), (mutex), &__ts);   \
+            }                                                            \
+        }                                                                \
+        (pred);                                                          \
+    })
+
+/*Logging and errors*/
+const char *esp_err_to_name(esp_err_t code) {
+    static char buf[16];
+    snprintf(buf, sizeof(buf), "0x%x", code);
+    return buf;
+}
+
+void shim_error_check_failed(esp_err_t rc, const char *file, int line, const char *expr) {
+    fprintf(stderr, "ESP_ERROR_CHECK failed: %s at %s:%d (%s)\n", esp_err_to_name(rc), file, line, expr);
+    abort();
+}
+
+void shim_log(esp_log_level_t level, const char *tag, const char *fmt, ...) {
+    static int verbose = -1;
+    va_list ap;
+    if (verbose < 0) {
+        verbose = (NULL != getenv("SHIM_LOG_VERBOSE"));
+    }
+    if ((level > ESP_LOG_WARN) && !verbose) {
+        return;
+    }
+    fprintf(stderr, "%c (%lld) %s: ", "NEWIDV"[level], (long long)(esp_timer_get_time() / 1000), tag);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+void esp_log_buffer_char(const char *tag, const void *buf, uint16_t len) {
+    shim_log(ESP_LOG_INFO, tag, "%.*s", (int)len, (const char *)buf);
+}
+
+/*Queues and semaphores*/
+struct shim_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    UBaseType_t len;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;
+    uint8_t *storage;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size) {
+    struct shim_queue *q = calloc(1, sizeof(*q));
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->changed, NULL);
+    q->len = len;
+    q->item_size = item_size;
+    q->storage = calloc(len, item_size ? item_size : 1);
+    return q;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t len, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *ctrl) {
+    return xQueueCreate(len, item_size);
+}
+
+BaseType_t xQueueGenericSend(QueueHandle_t q, const void *item, TickType_t ticks, BaseType_t pos) {
+    BaseType_t ok;
+    pthread_mutex_lock(&q->lock);
+    ok = SHIM_WAIT(&q->changed, &q->lock, ticks, q->count < q->len);
+    if (ok) {
+        UBaseType_t slot;
+        if (queueSEND_TO_FRONT == pos) {
+            q->head = (q->head + q->len - 1) % q->len;
+            slot = q->head;
+        } else {
+            slot = (q->head + q->count) % q->len;
+        }
+        if (q->item_size) {
+            memcpy(q->storage + slot * q->item_size, item, q->item_size);
+        }
+        q->count++;
+        pthread_cond_broadcast(&q->changed);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ok ? pdPASS : pdFAIL;
+}
+
+BaseType_t xQueueGenericReceive(QueueHandle_t q, void *item, TickType_t ticks, BaseType_t peek) {
+    BaseType_t ok;
+    pthread_mutex_lock(&q->lock);
+    ok = SHIM_WAIT(&q->changed, &q->lock, ticks, q->count > 0);
+    if (ok) {
+        if (q->item_size && item) {
+            memcpy(item, q->storage + q->head * q->item_size, q->item_size);
+        }
+        if (!peek) {
+            q->head = (q->head + 1) % q->len;
+            q->count--;
+            pthread_cond_broadcast(&q->changed);
+        }
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ok ? pdPASS : pdFAIL;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+    UBaseType_t n;
+    pthread_mutex_lock(&q->lock);
+    n = q->count;
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q) {
+    return q->len - uxQueueMessagesWaiting(q);
+}
+
+BaseType_t xQueueReset(QueueHandle_t q) {
+    pthread_mutex_lock(&q->lock);
+    q->count = 0;
+    q->head = 0;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    SemaphoreHandle_t s = xQueueCreate(1, 0);
+    xSemaphoreGive(s);
+    return s;
+}
+
+/*Event groups*/
+struct shim_event_group {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    EventBits_t bits;
+};
+
+EventGroupHandle_t xEventGroupCreate(void) {
+    EventGroupHandle_t g = calloc(1, sizeof(*g));
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->cond, NULL);
+    return g;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    EventBits_t ret;
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    ret = group->bits;
+    pthread_cond_broadcast(&group->cond);
+    pthread_mutex_unlock(&group->lock);
+    return ret;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    EventBits_t ret;
+    pthread_mutex_lock(&group->lock);
+    ret = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return ret;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    EventBits_t ret;
+    pthread_mutex_lock(&group->lock);
+    ret = group->bits;
+    pthread_mutex_unlock(&group->lock);
+    return ret;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit, BaseType_t wait_all,
+                                TickType_t ticks) {
+    EventBits_t ret;
+    pthread_mutex_lock(&group->lock);
+    SHIM_WAIT(&group->cond, &group->lock, ticks,
+              wait_all ? ((group->bits & bits) == bits) : ((group->bits & bits) != 0));
+    ret = group->bits;
+    if (clear_on_exit) {
+        group->bits &= ~bits;
+    }
+    pthread_mutex_unlock(&group->lock);
+    return ret;
+}
+
+/*Tasks*/
+struct shim_task {
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+};
+
+static void *__task_entry(void *arg) {
+    struct shim_task *t = arg;
+    t->fn(t->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *handle) {
+    struct shim_task *t = calloc(1, sizeof(*t));
+    t->fn = fn;
+    t->arg = arg;
+    if (0 != pthread_create(&t->thread, NULL, __task_entry, t)) {
+        free(t);
+        return pdFAIL;
+    }
+    pthread_detach(t->thread);
+    if (handle) {
+        *handle = t;
+    }
+    return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, StackType_t *st, StaticTask_t *tcb) {
+    TaskHandle_t handle = NULL;
+    xTaskCreate(fn, name, stack, arg, prio, &handle);
+    return handle;
+}
+
+void vTaskDelete(TaskHandle_t handle) {
+    if (NULL == handle) {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    usleep((useconds_t)ticks * 1000);
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t handle) {
+    return 0;
+}
+
+/*Ring buffer, every item is a separate allocation*/
+struct shim_ringbuf {
+    QueueHandle_t items;
+    pthread_mutex_t lock;
+    size_t size;
+    size_t used;
+};
+
+struct shim_ringbuf_item {
+    size_t len;
+    uint8_t data[];
+};
+
+RingbufHandle_t xRingbufferCreate(size_t size, RingbufferType_t type) {
+    struct shim_ringbuf *rb = calloc(1, sizeof(*rb));
+    rb->items = xQueueCreate(size / 8, sizeof(struct shim_ringbuf_item *));
+    pthread_mutex_init(&rb->lock, NULL);
+    rb->size = size;
+    return rb;
+}
+
+UBaseType_t xRingbufferSend(RingbufHandle_t rb, const void *data, size_t size, TickType_t ticks) {
+    struct shim_ringbuf_item *item;
+    /*Same 8 byte item header and 4 byte alignment as the IDF no split buffer*/
+    size_t cost = 8 + ((size + 3) & ~3);
+    pthread_mutex_lock(&rb->lock);
+    if ((rb->used + cost) > rb->size) {
+        pthread_mutex_unlock(&rb->lock);
+        return pdFALSE;
+    }
+    rb->used += cost;
+    pthread_mutex_unlock(&rb->lock);
+    item = malloc(sizeof(*item) + size);
+    item->len = size;
+    memcpy(item->data, data, size);
+    return xQueueSend(rb->items, &item, ticks);
+}
+
+void *xRingbufferReceive(RingbufHandle_t rb, size_t *size, TickType_t ticks) {
+    struct shim_ringbuf_item *item;
+    if (pdPASS != xQueueReceive(rb->items, &item, ticks)) {
+        return NULL;
+    }
+    *size = item->len;
+    return item->data;
+}
+
+void vRingbufferReturnItem(RingbufHandle_t rb, void *data) {
+    struct shim_ringbuf_item *item = (struct shim_ringbuf_item *)((uint8_t *)data - offsetof(struct shim_ringbuf_item, data));
+    pthread_mutex_lock(&rb->lock);
+    rb->used -= 8 + ((item->len + 3) & ~3);
+    pthread_mutex_unlock(&rb->lock);
+    free(item);
+}
+
+size_t xRingbufferGetCurFreeSize(RingbufHandle_t rb) {
+    size_t free_bytes;
+    pthread_mutex_lock(&rb->lock);
+    free_bytes = rb->size - rb->used;
+    pthread_mutex_unlock(&rb->lock);
+    return free_bytes;
+}
+
+/*nvs, a handful of blobs in memory*/
+#define SHIM_NVS_KEYS (32)
+static struct {
+    char key[32];
+    uint8_t *value;
+    size_t len;
+} nvs_store[SHIM_NVS_KEYS];
+static pthread_mutex_t nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+esp_err_t nvs_flash_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle) {
+    *handle = 1;
+    return ESP_OK;
+}
+
+static int __nvs_find(const char *key) {
+    for (int i = 0; i < SHIM_NVS_KEYS; i++) {
+        if ((NULL != nvs_store[i].value) && (0 == strcmp(nvs_store[i].key, key))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *len) {
+    esp_err_t rc = ESP_ERR_NVS_NOT_FOUND;
+    pthread_mutex_lock(&nvs_lock);
+    int i = __nvs_find(key);
+    if (i >= 0) {
+        if (NULL == out) {
+            *len = nvs_store[i].len;
+            rc = ESP_OK;
+        } else if (*len >= nvs_store[i].len) {
+            memcpy(out, nvs_store[i].value, nvs_store[i].len);
+            *len = nvs_store[i].len;
+            rc = ESP_OK;
+        } else {
+            rc = ESP_ERR_INVALID_SIZE;
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return rc;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t len) {
+    esp_err_t rc = ESP_ERR_NO_MEM;
+    pthread_mutex_lock(&nvs_lock);
+    int i = __nvs_find(key);
+    for (int j = 0; (i < 0) && (j < SHIM_NVS_KEYS); j++) {
+        if (NULL == nvs_store[j].value) {
+            i = j;
+        }
+    }
+    if (i >= 0) {
+        free(nvs_store[i].value);
+        snprintf(nvs_store[i].key, sizeof(nvs_store[i].key), "%s", key);
+        nvs_store[i].value = malloc(len ? len : 1);
+        memcpy(nvs_store[i].value, value, len);
+        nvs_store[i].len = len;
+        rc = ESP_OK;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return rc;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    esp_err_t rc = ESP_ERR_NVS_NOT_FOUND;
+    pthread_mutex_lock(&nvs_lock);
+    int i = __nvs_find(key);
+    if (i >= 0) {
+        free(nvs_store[i].value);
+        nvs_store[i].value = NULL;
+        rc = ESP_OK;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return rc;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+}
+
+/*Fake bluedroid*/
+#define SHIM_GATTS_IF (3)
+#define SHIM_BTC_QUEUE_LEN (64)
+
+typedef struct {
+    esp_gatts_cb_event_t event;
+    esp_ble_gatts_cb_param_t param;
+    uint8_t *value;
+} shim_btc_evt_t;
+
+static esp_gatts_cb_t gatts_cb = NULL;
+static esp_gap_ble_cb_t gap_cb = NULL;
+static shim_notify_hook_t notify_hook = NULL;
+static shim_response_hook_t response_hook = NULL;
+static QueueHandle_t btc_queue = NULL;
+static volatile int btc_pending = 0;
+static volatile bool attr_tab_ready = false;
+static uint16_t attr_handles[64];
+static pthread_mutex_t btc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t btc_idle = PTHREAD_COND_INITIALIZER;
+
+static void btc_task(void *arg) {
+    shim_btc_evt_t evt;
+    for (;;) {
+        xQueueReceive(btc_queue, &evt, portMAX_DELAY);
+        if (evt.value) {
+            evt.param.write.value = evt.value;
+        }
+        gatts_cb(evt.event, SHIM_GATTS_IF, &evt.param);
+        if (ESP_GATTS_CREAT_ATTR_TAB_EVT == evt.event) {
+            attr_tab_ready = true;
+        }
+        free(evt.value);
+        pthread_mutex_lock(&btc_lock);
+        btc_pending--;
+        pthread_cond_broadcast(&btc_idle);
+        pthread_mutex_unlock(&btc_lock);
+    }
+}
+
+void shim_bt_post(esp_gatts_cb_event_t event, esp_ble_gatts_cb_param_t *param) {
+    shim_btc_evt_t evt = {.event = event, .param = *param, .value = NULL};
+    if ((ESP_GATTS_WRITE_EVT == event) && (param->write.len > 0)) {
+        evt.value = malloc(param->write.len);
+        memcpy(evt.value, param->write.value, param->write.len);
+    }
+    pthread_mutex_lock(&btc_lock);
+    btc_pending++;
+    pthread_mutex_unlock(&btc_lock);
+    xQueueSend(btc_queue, &evt, portMAX_DELAY);
+}
+
+void shim_bt_sync(void) {
+    pthread_mutex_lock(&btc_lock);
+    while (btc_pending > 0) {
+        pthread_cond_wait(&btc_idle, &btc_lock);
+    }
+    pthread_mutex_unlock(&btc_lock);
+}
+
+bool shim_bt_ready(void) {
+    return attr_tab_ready;
+}
+
+void shim_bt_set_notify_hook(shim_notify_hook_t hook) {
+    notify_hook = hook;
+}
+
+void shim_bt_set_response_hook(shim_response_hook_t hook) {
+    response_hook = hook;
+}
+
+esp_err_t esp_bt_controller_mem_release(esp_bt_mode_t mode) {
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_controller_init(esp_bt_controller_config_t *cfg) {
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_controller_enable(esp_bt_mode_t mode) {
+    return ESP_OK;
+}
+
+esp_err_t esp_bluedroid_init(void) {
+    if (NULL == btc_queue) {
+        btc_queue = xQueueCreate(SHIM_BTC_QUEUE_LEN, sizeof(shim_btc_evt_t));
+        xTaskCreate(btc_task, "btc", 0, NULL, 0, NULL);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_bluedroid_enable(void) {
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t cb) {
+    gap_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_set_device_name(const char *name) {
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_config_adv_data_raw(uint8_t *data, uint32_t len) {
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_config_scan_rsp_data_raw(uint8_t *data, uint32_t len) {
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_start_advertising(esp_ble_adv_params_t *params) {
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_stop_advertising(void) {
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_disconnect(esp_bd_addr_t addr) {
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_register_callback(esp_gatts_cb_t cb) {
+    gatts_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_app_register(uint16_t app_id) {
+    esp_ble_gatts_cb_param_t param = {.reg = {.status = ESP_GATT_OK, .app_id = app_id}};
+    shim_bt_post(ESP_GATTS_REG_EVT, &param);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_create_attr_tab(const esp_gatts_attr_db_t *db, esp_gatt_if_t gatts_if, uint8_t max_nb_attr, uint8_t srvc_inst_id) {
+    esp_ble_gatts_cb_param_t param = {.add_attr_tab = {.status = ESP_GATT_OK, .num_handle = max_nb_attr, .handles = attr_handles}};
+    for (int i = 0; i < max_nb_attr; i++) {
+        attr_handles[i] = SHIM_ATTR_HANDLE_BASE + i;
+    }
+    shim_bt_post(ESP_GATTS_CREAT_ATTR_TAB_EVT, &param);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_start_service(uint16_t handle) {
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_send_indicate(esp_gatt_if_t gatts_if, uint16_t conn_id, uint16_t handle, uint16_t len, uint8_t *value, bool need_confirm) {
+    if (notify_hook) {
+        notify_hook(handle, value, len);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_send_response(esp_gatt_if_t gatts_if, uint16_t conn_id, uint32_t trans_id, esp_gatt_status_t status, esp_gatt_rsp_t *rsp) {
+    if (response_hook) {
+        response_hook(status, rsp);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_set_attr_value(uint16_t handle, uint16_t len, const uint8_t *value) {
+    return ESP_OK;
+}
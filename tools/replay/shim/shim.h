@@ -0,0 +1,174 @@
+#pragma once
+/*Minimal POSIX stand-in for the FreeRTOS, ESP-IDF and bluedroid APIs used by main/src,
+  just enough to run console_ll and ble_spp_server on Linux for replay. Not a general port.*/
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*esp_err*/
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_NOT_SUPPORTED 0x106
+#define ESP_ERR_TIMEOUT 0x107
+#define ESP_ERR_NVS_BASE 0x1100
+#define ESP_ERR_NVS_NOT_FOUND (ESP_ERR_NVS_BASE + 0x02)
+#define ESP_ERR_NVS_NO_FREE_PAGES (ESP_ERR_NVS_BASE + 0x0d)
+#define ESP_ERR_NVS_NEW_VERSION_FOUND (ESP_ERR_NVS_BASE + 0x10)
+const char *esp_err_to_name(esp_err_t code);
+void shim_error_check_failed(esp_err_t rc, const char *file, int line, const char *expr);
+#define ESP_ERROR_CHECK(x)                                            \
+    do {                                                              \
+        esp_err_t __rc = (x);                                         \
+        if (__rc != ESP_OK) {                                         \
+            shim_error_check_failed(__rc, __FILE__, __LINE__, #x);    \
+        }                                                             \
+    } while (0)
+
+/*FreeRTOS, 1 ms tick*/
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint8_t StackType_t;
+typedef struct shim_queue *QueueHandle_t;
+typedef QueueHandle_t xQueueHandle;
+typedef QueueHandle_t SemaphoreHandle_t;
+typedef struct shim_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+typedef struct {
+    void *p[12];
+} StaticQueue_t;
+typedef StaticQueue_t StaticSemaphore_t;
+typedef struct {
+    void *p[4];
+} StaticTask_t;
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(m) pthread_mutex_lock(m)
+#define portEXIT_CRITICAL(m) pthread_mutex_unlock(m)
+#define portENTER_CRITICAL_SAFE(m) pthread_mutex_lock(m)
+#define portEXIT_CRITICAL_SAFE(m) pthread_mutex_unlock(m)
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define pdFALSE 0
+#define queueSEND_TO_BACK 0
+#define queueSEND_TO_FRONT 1
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size);
+QueueHandle_t xQueueCreateStatic(UBaseType_t len, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *ctrl);
+BaseType_t xQueueGenericSend(QueueHandle_t q, const void *item, TickType_t ticks, BaseType_t pos);
+BaseType_t xQueueGenericReceive(QueueHandle_t q, void *item, TickType_t ticks, BaseType_t peek);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q);
+BaseType_t xQueueReset(QueueHandle_t q);
+#define xQueueSend(q, item, ticks) xQueueGenericSend((q), (item), (ticks), queueSEND_TO_BACK)
+#define xQueueSendToBack(q, item, ticks) xQueueGenericSend((q), (item), (ticks), queueSEND_TO_BACK)
+#define xQueueSendToFront(q, item, ticks) xQueueGenericSend((q), (item), (ticks), queueSEND_TO_FRONT)
+#define xQueueReceive(q, item, ticks) xQueueGenericReceive((q), (item), (ticks), pdFALSE)
+#define xQueuePeek(q, item, ticks) xQueueGenericReceive((q), (item), (ticks), pdTRUE)
+
+typedef uint32_t EventBits_t;
+typedef struct shim_event_group *EventGroupHandle_t;
+typedef struct {
+    void *p[4];
+} StaticEventGroup_t;
+EventGroupHandle_t xEventGroupCreate(void);
+#define xEventGroupCreateStatic(ctrl) ((void)(ctrl), xEventGroupCreate())
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit, BaseType_t wait_all, TickType_t ticks);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+#define xSemaphoreCreateBinaryStatic(ctrl) ((void)(ctrl), xSemaphoreCreateBinary())
+#define xSemaphoreCreateMutexStatic(ctrl) ((void)(ctrl), xSemaphoreCreateMutex())
+#define xSemaphoreTake(s, ticks) xQueueGenericReceive((s), NULL, (ticks), pdFALSE)
+#define xSemaphoreGive(s) xQueueGenericSend((s), NULL, 0, queueSEND_TO_BACK)
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *handle);
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, StackType_t *st, StaticTask_t *tcb);
+void vTaskDelete(TaskHandle_t handle);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t handle);
+
+/*Ring buffer, no split items only*/
+typedef struct shim_ringbuf *RingbufHandle_t;
+typedef enum {
+    RINGBUF_TYPE_NOSPLIT = 0,
+    RINGBUF_TYPE_ALLOWSPLIT,
+    RINGBUF_TYPE_BYTEBUF,
+} RingbufferType_t;
+typedef struct {
+    void *p[12];
+} StaticRingbuffer_t;
+RingbufHandle_t xRingbufferCreate(size_t size, RingbufferType_t type);
+#define xRingbufferCreateStatic(size, type, storage, ctrl) ((void)(storage), (void)(ctrl), xRingbufferCreate((size), (type)))
+UBaseType_t xRingbufferSend(RingbufHandle_t rb, const void *data, size_t size, TickType_t ticks);
+void *xRingbufferReceive(RingbufHandle_t rb, size_t *size, TickType_t ticks);
+void vRingbufferReturnItem(RingbufHandle_t rb, void *item);
+size_t xRingbufferGetCurFreeSize(RingbufHandle_t rb);
+
+/*esp_log, only warnings and errors unless SHIM_LOG_VERBOSE is set in the environment*/
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+void shim_log(esp_log_level_t level, const char *tag, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+#define ESP_LOGE(tag, fmt, ...) shim_log(ESP_LOG_ERROR, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) shim_log(ESP_LOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) shim_log(ESP_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) shim_log(ESP_LOG_DEBUG, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOG_BUFFER_HEXDUMP(tag, buf, len, level) \
+    do {                                             \
+    } while (0)
+#define ESP_LOG_BUFFER_HEX(tag, buf, len) \
+    do {                                  \
+    } while (0)
+void esp_log_buffer_char(const char *tag, const void *buf, uint16_t len);
+int64_t esp_timer_get_time(void);
+typedef struct shim_timer *esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+typedef struct {
+    esp_timer_cb_t callback;
+    void *arg;
+    int dispatch_method;
+    const char *name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+
+/*nvs, kept in memory for the lifetime of the process*/
+typedef uint32_t nvs_handle_t;
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE,
+} nvs_open_mode_t;
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *len);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t len);
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key);
+esp_err_t nvs_commit(nvs_handle_t handle);
+void nvs_close(nvs_handle_t handle);
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Extract a SPPCAP dump captured from the device console into a .sppcap file.
+
+Usage: spp_capture_extract.py <console log> <out.sppcap> [--list]
+
+The file is the 8 byte magic SPPCAP01 followed by the captured chunks as laid out by
+main/src/spp_capture.c: 32bit microsecond timestamp, direction, 16bit length, payload.
+Replay it with tools/replay/sppreplay.
+"""
+import argparse
+import struct
+import sys
+
+MAGIC = b"SPPCAP01"
+DIRS = {0: "DOWNLINK", 1: "PRODUCER", 2: "UPLINK"}
+
+
+def parse(lines):
+    data = bytearray()
+    expected = None
+    dropped = 0
+    for line in lines:
+        idx = line.find("SPPCAP ")
+        if idx < 0:
+            continue
+        field = line[idx + len("SPPCAP "):].split()
+        if not field:
+            continue
+        if field[0] == "BEGIN":
+            data = bytearray()
+            expected = int(field[1])
+        elif field[0] == "END":
+            dropped = int(field[1])
+        else:
+            data += bytes.fromhex(field[0])
+    if expected is not None and expected != len(data):
+        sys.exit("Dump is %d bytes, expected %d, console lines lost?" % (len(data), expected))
+    return bytes(data), dropped
+
+
+def chunks(data):
+    off = 0
+    while off + 7 <= len(data):
+        ts, direction, length = struct.unpack_from("<IBH", data, off)
+        yield ts, direction, data[off + 7:off + 7 + length]
+        off += 7 + length
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("log", help="console log containing a SPPCAP dump, - for stdin")
+    parser.add_argument("out", help="capture file to write")
+    parser.add_argument("--list", action="store_true", help="print every chunk")
+    args = parser.parse_args()
+    src = sys.stdin if args.log == "-" else open(args.log, errors="replace")
+    data, dropped = parse(src)
+    if not data:
+        sys.exit("No SPPCAP dump found")
+    count = {d: 0 for d in DIRS}
+    t0 = None
+    for ts, direction, payload in chunks(data):
+        count[direction] = count.get(direction, 0) + 1
+        if t0 is None:
+            t0 = ts
+        if args.list:
+            print("%10d %-8s %4d %r" % ((ts - t0) & 0xffffffff, DIRS.get(direction, str(direction)), len(payload), payload[:40]))
+    with open(args.out, "wb") as f:
+        f.write(MAGIC + data)
+    print("%d bytes, %s, %d chunks dropped on device" % (
+        len(data), ", ".join("%d %s" % (count[d], DIRS[d]) for d in DIRS), dropped))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+"""Rebuild the full records from a spp_delta encoded uplink, frame layout in main/src/spp_delta.h.
+
+Usage: spp_delta_decode.py <stream> [--sppcap] [--stats]
+
+The stream is the record mode uplink as the client receives it, every record a 16bit little endian
+length followed by the payload. With --sppcap it is taken from the UPLINK chunks of a capture written
+by spp_capture_extract.py. Records that are not delta frames are skipped. Every decoded record is
+printed as "<schema> <seq> name=value ...".
+"""
+import argparse
+import struct
+import sys
+
+FRAME_SCHEMA, FRAME_KEY, FRAME_DELTA = 0xD0, 0xD1, 0xD2
+# spp_delta_type_t: struct format, signed
+TYPES = {0: ("<B", False), 1: ("<b", True), 2: ("<H", False), 3: ("<h", True),
+         4: ("<I", False), 5: ("<i", True), 6: ("<f", False)}
+F32 = 6
+
+
+class Schema:
+    def __init__(self, payload):
+        self.num, self.interval = payload[2], struct.unpack_from("<H", payload, 3)[0]
+        off = 5
+        self.name, off = read_str(payload, off)
+        self.fields = []
+        for _ in range(self.num):
+            ftype = payload[off]
+            fname, off = read_str(payload, off + 1)
+            self.fields.append((fname, ftype))
+        self.prev = None
+        self.seq = None
+
+
+def read_str(buf, off):
+    n = buf[off]
+    return buf[off + 1:off + 1 + n].decode(errors="replace"), off + 1 + n
+
+
+def read_varint(buf, off):
+    v = shift = 0
+    while True:
+        b = buf[off]
+        off += 1
+        v |= (b & 0x7f) << shift
+        shift += 7
+        if not b & 0x80:
+            return v, off
+
+
+def bits(ftype):
+    return struct.calcsize(TYPES[ftype][0]) * 8
+
+
+def value(raw, ftype):
+    """raw is the sign extended 32bit pattern the encoder keeps"""
+    fmt, signed = TYPES[ftype]
+    if ftype == F32:
+        return struct.unpack("<f", struct.pack("<I", raw))[0]
+    raw &= (1 << bits(ftype)) - 1
+    if signed and raw >> (bits(ftype) - 1):
+        raw -= 1 << bits(ftype)
+    return raw
+
+
+def fmt(v):
+    return "%.9g" % v if isinstance(v, float) else str(v)
+
+
+def records(stream):
+    off = 0
+    while off + 2 <= len(stream):
+        n = struct.unpack_from("<H", stream, off)[0]
+        if off + 2 + n > len(stream):
+            break
+        yield stream[off + 2:off + 2 + n]
+        off += 2 + n
+
+
+def sppcap_uplink(data):
+    if data[:8] != b"SPPCAP01":
+        sys.exit("Not a .sppcap file")
+    out = bytearray()
+    off = 8
+    while off + 7 <= len(data):
+        _, direction, length = struct.unpack_from("<IBH", data, off)
+        if direction == 2:
+            out += data[off + 7:off + 7 + length]
+        off += 7 + length
+    return bytes(out)
+
+
+def decode(stream, out, stats):
+    schemas = {}
+    for payload in records(stream):
+        if not payload or payload[0] not in (FRAME_SCHEMA, FRAME_KEY, FRAME_DELTA) or len(payload) < 3:
+            stats["other"] += 1
+            continue
+        kind, sid = payload[0], payload[1]
+        if kind == FRAME_SCHEMA:
+            schemas[sid] = Schema(payload)
+            stats["schema"] += 1
+            continue
+        s = schemas.get(sid)
+        seq = payload[2]
+        if s is None or (kind == FRAME_DELTA and (s.prev is None or seq != (s.seq + 1) & 0xff)):
+            # Unknown schema or a frame lost in between, wait for the next keyframe
+            if s is not None:
+                s.prev = None
+            stats["skipped"] += 1
+            continue
+        off = 3
+        if kind == FRAME_KEY:
+            cur = []
+            for _, ftype in s.fields:
+                f, signed = TYPES[ftype]
+                v = struct.unpack_from(f, payload, off)[0]
+                off += struct.calcsize(f)
+                cur.append(struct.unpack("<I", struct.pack("<f", v))[0] if ftype == F32 else v & 0xffffffff)
+            stats["key"] += 1
+        else:
+            nbytes = (s.num + 7) // 8
+            bitmap = payload[off:off + nbytes]
+            off += nbytes
+            cur = list(s.prev)
+            for i, (_, ftype) in enumerate(s.fields):
+                if not bitmap[i // 8] & (1 << (i % 8)):
+                    continue
+                if ftype == F32:
+                    cur[i] = struct.unpack_from("<I", payload, off)[0]
+                    off += 4
+                else:
+                    z, off = read_varint(payload, off)
+                    cur[i] = (cur[i] + ((z >> 1) ^ -(z & 1))) & 0xffffffff
+            stats["delta"] += 1
+        s.prev, s.seq = cur, seq
+        stats["bytes"] += len(payload) + 2
+        stats["raw"] += sum(bits(t) // 8 for _, t in s.fields) + 2
+        if out:
+            out.write("%s %d %s\n" % (s.name, seq, " ".join(
+                "%s=%s" % (name, fmt(value(v, t))) for (name, t), v in zip(s.fields, cur))))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("stream", help="record mode uplink bytes, - for stdin")
+    parser.add_argument("--sppcap", action="store_true", help="stream is a .sppcap capture")
+    parser.add_argument("--stats", action="store_true", help="print only the totals")
+    args = parser.parse_args()
+    data = sys.stdin.buffer.read() if args.stream == "-" else open(args.stream, "rb").read()
+    if args.sppcap:
+        data = sppcap_uplink(data)
+    stats = dict.fromkeys(("schema", "key", "delta", "skipped", "other", "bytes", "raw"), 0)
+    decode(data, None if args.stats else sys.stdout, stats)
+    print("%d schema, %d key and %d delta frames, %d skipped, %d other records; %d bytes for %d as raw records%s" % (
+        stats["schema"], stats["key"], stats["delta"], stats["skipped"], stats["other"], stats["bytes"], stats["raw"],
+        ", %.1f x" % (stats["raw"] / stats["bytes"]) if stats["bytes"] else ""), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
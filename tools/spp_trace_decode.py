@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+"""Decode a SPPTRACE dump captured from the device console.
+
+Usage: spp_trace_decode.py <console log> [--events]
+
+Rebuilds per message latency for
+  downlink: client write (RX_WRITE) -> consumer wakeup (APP_WAKEUP)
+  uplink:   line released by putc (TX_ENQUEUE) -> last fragment notified (TX_DONE)
+and prints percentiles. Record layout matches spp_trace_rec_t in main/src/spp_trace.c.
+"""
+import argparse
+import collections
+import struct
+import sys
+
+EVENTS = {
+    1: "GATTS_EVT",
+    2: "RX_WRITE",
+    3: "RX_DELIVER",
+    4: "APP_WAKEUP",
+    5: "TX_ENQUEUE",
+    6: "TX_WAKEUP",
+    7: "TX_FRAGMENT",
+    8: "TX_DONE",
+    9: "CONGEST",
+    10: "MARK",
+    11: "REL_ACK",
+    12: "REL_RETX",
+    13: "TX_ERROR",
+    14: "ADV_STAGE",
+    15: "RECONNECT",
+    16: "TX_DROP",
+    17: "PULL",
+}
+RECORD_HDR_LEN = 2  # CONSOLE_RECORD_HDR_LEN
+TX_DROP_OLDEST = 2  # CONSOLE_LL_TX_DROP_OLDEST
+
+
+def parse(lines):
+    records = []
+    dropped = 0
+    for line in lines:
+        idx = line.find("SPPTRACE ")
+        if idx < 0:
+            continue
+        field = line[idx + len("SPPTRACE "):].split()
+        if not field:
+            continue
+        if field[0] == "BEGIN":
+            records = []
+        elif field[0] == "END":
+            dropped = int(field[1])
+        else:
+            ts, evt, aux, arg = struct.unpack("<IBBH", bytes.fromhex(field[0]))
+            records.append((ts, evt, aux, arg))
+    return unwrap(records), dropped
+
+
+def unwrap(records):
+    """Timestamps are 32bit microseconds, extend them across wraps. Only a jump back by more than half the range is a
+    wrap, anything smaller is two records stamped out of order"""
+    out = []
+    base = 0
+    last = None
+    for ts, evt, aux, arg in records:
+        if last is not None and last - ts > 1 << 31:
+            base += 1 << 32
+        last = ts
+        out.append((base + ts, evt, aux, arg))
+    return out
+
+
+def pair(records, start, end):
+    """Match by byte counts like __flow_mark()/__flow_advance() in tools/replay/replay.c. start() returns the bytes an
+    event puts into the stream, end() the stream offset an event reached and whether it delivered them. A start
+    completes at the first end reaching its last byte, so lines coalesced into one notification complete together"""
+    marks = collections.deque()
+    offered = 0
+    lat = []
+    for ts, evt, aux, arg in records:
+        n = start(evt, aux, arg)
+        if n:
+            offered += n
+            marks.append((offered, ts))
+            continue
+        reached = end(evt, aux, arg)
+        if reached is None:
+            continue
+        offset, delivered = reached
+        while marks and marks[0][0] <= offset:
+            t0 = marks.popleft()[1]
+            if delivered:
+                lat.append(ts - t0)
+    return lat
+
+
+def uplink_start(evt, aux, arg):
+    return arg + (RECORD_HDR_LEN if aux else 0) if evt == 5 else 0
+
+
+class Uplink:
+    """Uplink bytes taken out of the queue: notified, pulled by the client or dropped by CONSOLE_LL_TX_DROP_OLDEST"""
+
+    def __init__(self):
+        self.done = 0
+
+    def notified(self, evt, aux, arg):
+        if evt in (8, 17) or (evt == 16 and aux == TX_DROP_OLDEST):
+            self.done += arg
+            return self.done, evt != 16
+        return None
+
+    def woken(self, evt, aux, arg):
+        # link_task finished the previous line before it wakes up again, arg is what it found waiting
+        if evt == 6:
+            return self.done + arg, True
+        reached = self.notified(evt, aux, arg)
+        # Notified bytes were counted at their wakeup already, only drops complete a mark here
+        return reached if reached and not reached[1] else None
+
+
+def downlink_start(evt, aux, arg):
+    return arg if evt == 2 else 0
+
+
+class Downlink:
+    """Downlink bytes delivered to console_ll and read by the consumer"""
+
+    def __init__(self):
+        self.delivered = 0
+        self.consumed = 0
+        self.record = False
+
+    def delivered_to(self, evt, aux, arg):
+        if evt == 3:
+            self.delivered += arg + (RECORD_HDR_LEN if aux else 0)
+            self.record = bool(aux)
+            return self.delivered, True
+        return None
+
+    def consumer(self, evt, aux, arg):
+        self.delivered_to(evt, aux, arg)
+        if evt != 4:
+            return None
+        # A record consumer drains every record delivered, a text consumer reads the line it was signaled for
+        self.consumed = self.delivered if self.record else self.consumed + arg
+        return self.consumed, True
+
+
+def percentile(values, pct):
+    ordered = sorted(values)
+    k = min(len(ordered) - 1, int(round(pct / 100.0 * (len(ordered) - 1))))
+    return ordered[k]
+
+
+def report(name, lat):
+    if not lat:
+        print("%-28s no samples" % name)
+        return
+    print("%-28s n=%-5d p50=%-8d p90=%-8d p99=%-8d max=%-8d us" % (
+        name, len(lat), percentile(lat, 50), percentile(lat, 90), percentile(lat, 99), max(lat)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("log", help="console log containing a SPPTRACE dump, - for stdin")
+    parser.add_argument("--events", action="store_true", help="print every decoded event")
+    args = parser.parse_args()
+    src = sys.stdin if args.log == "-" else open(args.log, errors="replace")
+    records, dropped = parse(src)
+    if not records:
+        sys.exit("No SPPTRACE records found")
+    if args.events:
+        t0 = records[0][0]
+        for ts, evt, aux, arg in records:
+            print("%10d %-12s aux=%-3d arg=%d" % (ts - t0, EVENTS.get(evt, str(evt)), aux, arg))
+    print("%d records, %d dropped during dump" % (len(records), dropped))
+    report("write -> consumer", pair(records, downlink_start, Downlink().consumer))
+    report("write -> deliver", pair(records, downlink_start, Downlink().delivered_to))
+    report("putc -> notify done", pair(records, uplink_start, Uplink().notified))
+    report("putc -> link_task wakeup", pair(records, uplink_start, Uplink().woken))
+    congested = [r for r in records if r[1] == 9 and r[3] == 1]
+    print("%d congestion events" % len(congested))
+    retx = [r for r in records if r[1] == 12]
+    if retx:
+        print("%d retransmit rounds, %d notifications resent" % (len(retx), sum(r[2] for r in retx)))
+    errors = [r for r in records if r[1] == 13]
+    if errors:
+        print("%d notifications rejected by the stack" % len(errors))
+    drops = [r for r in records if r[1] == 16]
+    if drops:
+        print("%d producer writes dropped %d bytes" % (len(drops), sum(r[3] for r in drops)))
+    pulls = [r for r in records if r[1] == 17]
+    if pulls:
+        print("%d reads pulled %d bytes, %d of them read blobs" % (len(pulls), sum(r[3] for r in pulls), sum(r[2] for r in pulls)))
+    reconnect = [r for r in records if r[1] == 15]
+    if reconnect:
+        report("disconnect -> connect", [r[3] * 1000 for r in reconnect])
+        for _, _, stage, ms in reconnect:
+            print("  reconnected after %5d ms in stage %s" % (ms, "directed" if stage == 0xff else stage))
+
+
+if __name__ == "__main__":
+    main()